@@ -76,9 +76,14 @@ static int recvtic;
 int gametic;
 
 // When set to true, a single tic is run each time TryRunTics() is called.
-// This is used for -timedemo mode.
+// This is used for -timedemo mode, and always by the headless build,
+// which has no display to pace itself against.
 
+#ifdef HEADLESS
+boolean singletics = true;
+#else
 boolean singletics = false;
+#endif
 
 // Index of the local player.
 
@@ -790,8 +790,12 @@ void D_DoomMain(void)
     D_BindVariables();
     M_LoadDefaults();
 
-    // Save configuration at exit.
+    // Save configuration at exit.  The headless build never binds the
+    // video, input or joystick settings, and saving would drop them
+    // from the shared configuration file.
+#ifndef HEADLESS
     I_AtExit(M_SaveDefaults, false);
+#endif
 
     // Find main IWAD file and load it.
     iwadfile = D_FindIWAD(IWAD_MASK_DOOM, &gamemission);
@@ -54,12 +54,35 @@ typedef union
 typedef actionf_t  think_t;
 
 
+// Thinkers are also kept on one list per class,
+//  so scans for one kind need not walk them all.
+typedef enum
+{
+    th_mobj,
+    th_mover,	// ceilings, doors, floors, plats
+    th_light,
+    th_delete,	// removed, waiting to be freed
+    NUMTHCLASS
+
+} thclass_t;
+
 // Doubly linked list of actors.
 typedef struct thinker_s
 {
     struct thinker_s*	prev;
     struct thinker_s*	next;
     think_t		function;
+
+    // Links within the class list, in the same order.
+    struct thinker_s*	cprev;
+    struct thinker_s*	cnext;
+
+    // Place in the list, counting up as thinkers are added.
+    int			seq;
+
+    // Tic a sleeping thinker next has to run, -1 if only being
+    //  disturbed can wake it, or 0 if awake.  See P_RunThinkers.
+    int			waketic;
     
 } thinker_t;
 
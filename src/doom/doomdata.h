@@ -172,7 +172,10 @@ typedef PACKED_STRUCT (
 // BSP node structure.
 
 // Indicate a leaf.
-#define	NF_SUBSECTOR	0x8000
+#define	NF_SUBSECTOR	0x80000000
+
+// The same, in the 16-bit children of mapnode_t.
+#define	NF_SUBSECTOR_VANILLA	0x8000
 
 typedef PACKED_STRUCT (
 {
@@ -186,7 +189,7 @@ typedef PACKED_STRUCT (
   // clip against view frustum.
   short		bbox[2][4];
 
-  // If NF_SUBSECTOR its a subsector,
+  // If NF_SUBSECTOR_VANILLA its a subsector,
   // else it's a node of another subtree.
   unsigned short	children[2];
 
@@ -194,6 +197,46 @@ typedef PACKED_STRUCT (
 
 
 
+// Extended nodes, as written by ZDBSP.  The whole BSP goes in the
+// NODES lump, with SEGS and SSECTORS left empty: after the magic
+// come the number of vertexes kept from VERTEXES, then tables of
+// new vertexes, subsector seg counts, segs and nodes, each table
+// preceded by a 32-bit count.  Indices are 32-bit throughout.
+#define XNOD_MAGIC	"XNOD"
+
+// The same, zlib compressed after the magic.
+#define ZNOD_MAGIC	"ZNOD"
+
+typedef PACKED_STRUCT (
+{
+  // 16.16 fixed point.
+  int		x;
+  int		y;
+}) mapvertex_x_t;
+
+typedef PACKED_STRUCT (
+{
+  unsigned int		v1;
+  unsigned int		v2;
+  unsigned short	linedef;
+  unsigned char		side;
+}) mapseg_x_t;
+
+typedef PACKED_STRUCT (
+{
+  short		x;
+  short		y;
+  short		dx;
+  short		dy;
+  short		bbox[2][4];
+
+  // If NF_SUBSECTOR its a subsector.
+  unsigned int	children[2];
+
+}) mapnode_x_t;
+
+
+
 
 // Thing definition, position, orientation and type,
 // plus skill/visibility flags and attributes.
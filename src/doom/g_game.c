@@ -1385,6 +1385,7 @@ void G_DoLoadGame(void)
     savedleveltime = leveltime;
 
     // load a base level
+    demoplayback = false;
     G_InitNew(gameskill, gameepisode, gamemap);
 
     leveltime = savedleveltime;
@@ -1594,7 +1595,6 @@ void G_InitNew(skill_t skill, int episode, int map)
 
     usergame = true; // will be set false if a demo
     paused = false;
-    demoplayback = false;
     automapactive = false;
     viewactive = true;
     gameepisode = episode;
@@ -1858,12 +1858,15 @@ void G_DoPlayDemo(void)
 
     // don't spend a lot of time in loadlevel
     precache = false;
+
+    // Set before the level loads, so that level setup already
+    // leaves out everything a demo must not see.
+    demoplayback = true;
     G_InitNew(skill, episode, map);
     precache = true;
     starttime = I_GetTime();
 
     usergame = false;
-    demoplayback = true;
 }
 
 //
@@ -263,8 +263,8 @@ EV_DoDoor
 	
 	// new door thinker
 	rtn = 1;
-	door = Z_Malloc (sizeof(*door), PU_LEVSPEC, 0);
-	P_AddThinker (&door->thinker);
+	door = P_AllocateThinker (sizeof(*door), PU_LEVSPEC);
+	P_AddThinker (&door->thinker, th_mover);
 	sec->specialdata = door;
 
 	door->thinker.function.acp1 = (actionf_p1) T_VerticalDoor;
@@ -470,8 +470,8 @@ EV_VerticalDoor
 	
     
     // new door thinker
-    door = Z_Malloc (sizeof(*door), PU_LEVSPEC, 0);
-    P_AddThinker (&door->thinker);
+    door = P_AllocateThinker (sizeof(*door), PU_LEVSPEC);
+    P_AddThinker (&door->thinker, th_mover);
     sec->specialdata = door;
     door->thinker.function.acp1 = (actionf_p1) T_VerticalDoor;
     door->sector = sec;
@@ -520,9 +520,9 @@ void P_SpawnDoorCloseIn30 (sector_t* sec)
 {
     vldoor_t*	door;
 	
-    door = Z_Malloc ( sizeof(*door), PU_LEVSPEC, 0);
+    door = P_AllocateThinker ( sizeof(*door), PU_LEVSPEC);
 
-    P_AddThinker (&door->thinker);
+    P_AddThinker (&door->thinker, th_mover);
 
     sec->specialdata = door;
     sec->special = 0;
@@ -545,9 +545,9 @@ P_SpawnDoorRaiseIn5Mins
 {
     vldoor_t*	door;
 	
-    door = Z_Malloc ( sizeof(*door), PU_LEVSPEC, 0);
+    door = P_AllocateThinker ( sizeof(*door), PU_LEVSPEC);
     
-    P_AddThinker (&door->thinker);
+    P_AddThinker (&door->thinker, th_mover);
 
     sec->specialdata = door;
     sec->special = 0;
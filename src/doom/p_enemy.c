@@ -79,52 +79,71 @@ void A_Fall(mobj_t *actor);
 
 //
 // Called by P_NoiseAlert.
-// Recursively traverse adjacent sectors,
-// sound blocking lines cut off traversal.
+// Floods adjacent sectors breadth first, sound blocking lines cut
+// off traversal.  Every sector reachable without crossing a sound
+// blocking line is flooded first, then those reachable across one,
+// which leaves soundtraversed and soundtarget exactly as the old
+// recursive flood did.
 //
 
 mobj_t *soundtarget;
 
-void P_RecursiveSound(sector_t *sec, int soundblocks)
-{
-    int i;
-    line_t *check;
-    sector_t *other;
+static sector_t **soundqueue;
+static int soundqueuesize;
 
-    // wake up all monsters in this sector
-    if (sec->validcount == validcount && sec->soundtraversed <= soundblocks + 1)
+//
+// SoundOpen
+// Whether sound passes the line of adj, a neighbour of sec.
+// Cached until either sector's floor or ceiling moves.
+//
+static boolean SoundOpen(sector_t *sec, sectoradj_t *adj)
+{
+    if (adj->openstamp < sec->planestamp
+     || adj->openstamp < adj->sector->planestamp)
     {
-        return; // already flooded
+        P_LineOpening(adj->line);
+        adj->open = openrange > 0;
+        adj->openstamp = planecount;
     }
 
-    sec->validcount = validcount;
-    sec->soundtraversed = soundblocks + 1;
-    sec->soundtarget = soundtarget;
+    return adj->open;
+}
 
-    for (i = 0; i < sec->linecount; i++)
-    {
-        check = sec->lines[i];
-        if (!(check->flags & ML_TWOSIDED))
-            continue;
+//
+// FloodSound
+// Floods outward from the sectors in soundqueue[head..tail-1]
+// without crossing sound blocking lines.  Returns the new tail.
+//
+static int FloodSound(int head, int tail, int soundblocks)
+{
+    int i;
+    sector_t *sec;
+    sectoradj_t *adj;
+    sector_t *other;
 
-        P_LineOpening(check);
+    while (head < tail)
+    {
+        sec = soundqueue[head++];
 
-        if (openrange <= 0)
-            continue; // closed door
+        for (i = 0, adj = sec->adj; i < sec->adjcount; i++, adj++)
+        {
+            other = adj->sector;
 
-        if (sides[check->sidenum[0]].sector == sec)
-            other = sides[check->sidenum[1]].sector;
-        else
-            other = sides[check->sidenum[0]].sector;
+            if (other->validcount == validcount
+             || (adj->line->flags & ML_SOUNDBLOCK)
+             || !SoundOpen(sec, adj))
+            {
+                continue;
+            }
 
-        if (check->flags & ML_SOUNDBLOCK)
-        {
-            if (!soundblocks)
-                P_RecursiveSound(other, 1);
+            other->validcount = validcount;
+            other->soundtraversed = soundblocks + 1;
+            other->soundtarget = soundtarget;
+            soundqueue[tail++] = other;
         }
-        else
-            P_RecursiveSound(other, soundblocks);
     }
+
+    return tail;
 }
 
 
@@ -135,9 +154,59 @@ void P_RecursiveSound(sector_t *sec, int soundblocks)
 //
 void P_NoiseAlert(mobj_t *target, mobj_t *emmiter)
 {
+    int i;
+    int j;
+    int unblocked;
+    int tail;
+    sector_t *sec;
+    sectoradj_t *adj;
+    sector_t *other;
+
     soundtarget = target;
     validcount++;
-    P_RecursiveSound(emmiter->subsector->sector, 0);
+
+    // Each sector is queued at most once.
+    if (soundqueuesize < numsectors)
+    {
+        soundqueuesize = numsectors;
+        soundqueue = I_Realloc(soundqueue,
+                               soundqueuesize * sizeof(*soundqueue));
+    }
+
+    sec = emmiter->subsector->sector;
+    sec->validcount = validcount;
+    sec->soundtraversed = 1;
+    sec->soundtarget = soundtarget;
+    soundqueue[0] = sec;
+
+    unblocked = FloodSound(0, 1, 0);
+
+    // Step across one sound blocking line, and flood on from there.
+    tail = unblocked;
+
+    for (i = 0; i < unblocked; i++)
+    {
+        sec = soundqueue[i];
+
+        for (j = 0, adj = sec->adj; j < sec->adjcount; j++, adj++)
+        {
+            other = adj->sector;
+
+            if (other->validcount == validcount
+             || !(adj->line->flags & ML_SOUNDBLOCK)
+             || !SoundOpen(sec, adj))
+            {
+                continue;
+            }
+
+            other->validcount = validcount;
+            other->soundtraversed = 2;
+            other->soundtarget = soundtarget;
+            soundqueue[tail++] = other;
+        }
+    }
+
+    FloodSound(unblocked, tail, 1);
 }
 
 
@@ -527,11 +596,9 @@ void A_KeenDie(mobj_t *mo)
 
     // scan the remaining thinkers
     // to see if all Keens are dead
-    for (th = thinkercap.next; th != &thinkercap; th = th->next)
+    for (th = thinkerclasscap[th_mobj].cnext;
+         th != &thinkerclasscap[th_mobj]; th = th->cnext)
     {
-        if (th->function.acp1 != (actionf_p1) P_MobjThinker)
-            continue;
-
         mo2 = (mobj_t *) th;
         if (mo2 != mo && mo2->type == mo->type && mo2->health > 0)
         {
@@ -953,6 +1020,7 @@ void A_SkelMissile(mobj_t *actor)
 
     mo->x += mo->momx;
     mo->y += mo->momy;
+    P_SyncBlockThing(mo);
     mo->tracer = actor->target;
 }
 
@@ -1264,6 +1332,7 @@ void A_VileAttack(mobj_t *actor)
     // move the fire between the vile and the player
     fire->x = actor->target->x - FixedMul(24 * FRACUNIT, finecosine[an]);
     fire->y = actor->target->y - FixedMul(24 * FRACUNIT, finesine[an]);
+    P_SyncBlockThing(fire);
     P_RadiusAttack(fire, actor, 70);
 }
 
@@ -1397,13 +1466,12 @@ void A_PainShootSkull(mobj_t *actor, angle_t angle)
     // count total number of skull currently on the level
     count = 0;
 
-    currentthinker = thinkercap.next;
-    while (currentthinker != &thinkercap)
+    currentthinker = thinkerclasscap[th_mobj].cnext;
+    while (currentthinker != &thinkerclasscap[th_mobj])
     {
-        if ((currentthinker->function.acp1 == (actionf_p1) P_MobjThinker) &&
-            ((mobj_t *) currentthinker)->type == MT_SKULL)
+        if (((mobj_t *) currentthinker)->type == MT_SKULL)
             count++;
-        currentthinker = currentthinker->next;
+        currentthinker = currentthinker->cnext;
     }
 
     // if there are allready 20 skulls on the level,
@@ -1572,11 +1640,9 @@ void A_BossDeath(mobj_t *mo)
 
     // scan the remaining thinkers to see
     // if all bosses are dead
-    for (th = thinkercap.next; th != &thinkercap; th = th->next)
+    for (th = thinkerclasscap[th_mobj].cnext;
+         th != &thinkerclasscap[th_mobj]; th = th->cnext)
     {
-        if (th->function.acp1 != (actionf_p1) P_MobjThinker)
-            continue;
-
         mo2 = (mobj_t *) th;
         if (mo2 != mo && mo2->type == mo->type && mo2->health > 0)
         {
@@ -1664,12 +1730,9 @@ void A_BrainAwake(mobj_t *mo)
     numbraintargets = 0;
     braintargeton = 0;
 
-    for (thinker = thinkercap.next; thinker != &thinkercap;
-         thinker = thinker->next)
+    for (thinker = thinkerclasscap[th_mobj].cnext;
+         thinker != &thinkerclasscap[th_mobj]; thinker = thinker->cnext)
     {
-        if (thinker->function.acp1 != (actionf_p1) P_MobjThinker)
-            continue; // not a mobj
-
         m = (mobj_t *) thinker;
 
         if (m->type == MT_BOSSTARGET)
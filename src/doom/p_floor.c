@@ -36,6 +36,8 @@
 // FLOORS
 //
 
+int planecount;
+
 //
 // Move a plane (floor or ceiling) and check for crushing
 //
@@ -45,6 +47,10 @@ result_e T_MovePlane(sector_t *sector, fixed_t speed, fixed_t dest,
     boolean flag;
     fixed_t lastpos;
 
+    // Sight and sound through this sector may change.
+    sightstamp++;
+    sector->planestamp = ++planecount;
+
     switch (floorOrCeiling)
     {
         case 0:
@@ -258,8 +264,8 @@ int EV_DoFloor(line_t *line, floor_e floortype)
 
         // new floor thinker
         rtn = 1;
-        floor = Z_Malloc(sizeof(*floor), PU_LEVSPEC, 0);
-        P_AddThinker(&floor->thinker);
+        floor = P_AllocateThinker(sizeof(*floor), PU_LEVSPEC);
+        P_AddThinker(&floor->thinker, th_mover);
         sec->specialdata = floor;
         floor->thinker.function.acp1 = (actionf_p1) T_MoveFloor;
         floor->type = floortype;
@@ -445,8 +451,8 @@ int EV_BuildStairs(line_t *line, stair_e type)
 
         // new floor thinker
         rtn = 1;
-        floor = Z_Malloc(sizeof(*floor), PU_LEVSPEC, 0);
-        P_AddThinker(&floor->thinker);
+        floor = P_AllocateThinker(sizeof(*floor), PU_LEVSPEC);
+        P_AddThinker(&floor->thinker, th_mover);
         sec->specialdata = floor;
         floor->thinker.function.acp1 = (actionf_p1) T_MoveFloor;
         floor->direction = 1;
@@ -504,9 +510,9 @@ int EV_BuildStairs(line_t *line, stair_e type)
 
                 sec = tsec;
                 secnum = newsecnum;
-                floor = Z_Malloc(sizeof(*floor), PU_LEVSPEC, 0);
+                floor = P_AllocateThinker(sizeof(*floor), PU_LEVSPEC);
 
-                P_AddThinker(&floor->thinker);
+                P_AddThinker(&floor->thinker, th_mover);
 
                 sec->specialdata = floor;
                 floor->thinker.function.acp1 = (actionf_p1) T_MoveFloor;
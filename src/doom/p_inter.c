@@ -721,6 +721,9 @@ void P_DamageMobj(mobj_t *target, mobj_t *inflictor, mobj_t *source, int damage)
     fixed_t thrust;
     int temp;
 
+    if (target->thinker.waketic)
+        P_WakeThinker(&target->thinker);
+
     if (!(target->flags & MF_SHOOTABLE))
         return; // shouldn't happen...
 
@@ -30,10 +30,16 @@
 #define VIEWHEIGHT		(41*FRACUNIT)
 
 // mapblocks are used to check movement
-// against lines and things
-#define MAPBLOCKUNITS	128
+// against lines and things.
+// The BLOCKMAP lump uses 128 unit blocks; building with another
+//  MAPBLOCKBITS makes every level build its own blockmap instead.
+#ifndef MAPBLOCKBITS
+#define MAPBLOCKBITS	7
+#endif
+
+#define MAPBLOCKUNITS	(1<<MAPBLOCKBITS)
 #define MAPBLOCKSIZE	(MAPBLOCKUNITS*FRACUNIT)
-#define MAPBLOCKSHIFT	(FRACBITS+7)
+#define MAPBLOCKSHIFT	(FRACBITS+MAPBLOCKBITS)
 #define MAPBMASK		(MAPBLOCKSIZE-1)
 #define MAPBTOFRAC		(MAPBLOCKSHIFT-FRACBITS)
 
@@ -65,10 +71,18 @@
 // both the head and tail of the thinker list
 extern	thinker_t	thinkercap;	
 
+// heads and tails of the per-class lists
+extern	thinker_t	thinkerclasscap[NUMTHCLASS];
+
 
 void P_InitThinkers (void);
-void P_AddThinker (thinker_t* thinker);
+void P_AddThinker (thinker_t* thinker, thclass_t tclass);
+void* P_AllocateThinker (int size, int tag);
+void P_FreeThinker (thinker_t* thinker);
+void P_ClearThinkerPools (void);
 void P_RemoveThinker (thinker_t* thinker);
+void P_WakeThinker (thinker_t* thinker);
+void P_WakeAllThinkers (void);
 
 
 //
@@ -113,6 +127,7 @@ void 	P_RemoveMobj (mobj_t* th);
 mobj_t* P_SubstNullMobj (mobj_t* th);
 boolean	P_SetMobjState (mobj_t* mobj, statenum_t state);
 void 	P_MobjThinker (mobj_t* mobj);
+int	P_MobjIdleTics (mobj_t* mobj);
 
 void	P_SpawnPuff (fixed_t x, fixed_t y, fixed_t z);
 void 	P_SpawnBlood (fixed_t x, fixed_t y, fixed_t z, int damage);
@@ -148,12 +163,13 @@ typedef struct
     }			d;
 } intercept_t;
 
-// Extended MAXINTERCEPTS, to allow for intercepts overrun emulation.
+// Size of the intercepts table in Vanilla Doom.  The table here
+//  grows as needed; past this point the overrun is only emulated
+//  when asked for with -interceptsoverrun.
 
 #define MAXINTERCEPTS_ORIGINAL 128
-#define MAXINTERCEPTS          (MAXINTERCEPTS_ORIGINAL + 61)
 
-extern intercept_t	intercepts[MAXINTERCEPTS];
+extern intercept_t*	intercepts;
 extern intercept_t*	intercept_p;
 
 typedef boolean (*traverser_t) (intercept_t *in);
@@ -173,7 +189,11 @@ extern fixed_t		lowfloor;
 void 	P_LineOpening (line_t* linedef);
 
 boolean P_BlockLinesIterator (int x, int y, boolean(*func)(line_t*) );
+boolean P_BlockLinesBoxIterator (int x, int y, fixed_t* box,
+				 boolean(*func)(line_t*) );
 boolean P_BlockThingsIterator (int x, int y, boolean(*func)(mobj_t*) );
+boolean P_BlockThingsBoxIterator (int x, int y, fixed_t* box,
+				  boolean(*func)(mobj_t*) );
 
 #define PT_ADDLINES		1
 #define PT_ADDTHINGS	2
@@ -193,6 +213,9 @@ P_PathTraverse
 void P_UnsetThingPosition (mobj_t* thing);
 void P_SetThingPosition (mobj_t* thing);
 
+// Call after changing a thing's x, y or radius without relinking it.
+void P_SyncBlockThing (mobj_t* thing);
+
 
 //
 // P_MAP
@@ -232,6 +255,14 @@ boolean P_ChangeSector (sector_t* sector, boolean crunch);
 
 extern mobj_t*	linetarget;	// who got hit (or NULL)
 
+// Bumped every tic and whenever a floor or ceiling moves;
+//  P_CheckSight only reuses results cached under the current value.
+extern int	sightstamp;
+
+// Bumped whenever a floor or ceiling moves, and copied into the
+//  sector's planestamp.
+extern int	planecount;
+
 
 extern fixed_t attackrange;
 
@@ -266,14 +297,58 @@ P_RadiusAttack
 // P_SETUP
 //
 extern byte*		rejectmatrix;	// for fast sight rejection
-extern short*		blockmaplump;	// offsets in blockmap are from here
-extern short*		blockmap;
+extern int*		blockmaplump;	// offsets in blockmap are from here
+extern int*		blockmap;
 extern int		bmapwidth;
 extern int		bmapheight;	// in mapblocks
 extern fixed_t		bmaporgx;
 extern fixed_t		bmaporgy;	// origin of block map
 extern mobj_t**		blocklinks;	// for thing chains
 
+// The same things as blocklinks, as a flat array per cell, with
+//  what a box test needs copied inline.
+typedef struct
+{
+    fixed_t	x;
+    fixed_t	y;
+    fixed_t	radius;
+    mobj_t*	mobj;		// NULL once unlinked
+
+} blockthing_t;
+
+typedef struct
+{
+    blockthing_t* things;	// oldest first
+    int		numthings;	// including unlinked slots
+    int		numfree;	// unlinked slots
+    int		maxthings;
+    int		changes;	// bumped on every link and unlink
+    boolean	diverged;	// chain no longer matches the array
+
+} blockcell_t;
+
+extern blockcell_t*	blockcells;
+
+// What PIT_CheckLine looks at in a line to pass it over, packed
+//  into a copy of the blockmap lists.  The copy of the list at
+//  blockmap[i] starts at blocklines[blockmap[i] - blocklinebase],
+//  and line is -1 at the end of a list.
+typedef struct
+{
+    fixed_t	bbox[4];
+    fixed_t	x;		// v1
+    fixed_t	y;
+    fixed_t	dx;
+    fixed_t	dy;
+    int		slopetype;
+    int		line;
+
+} blockline_t;
+
+extern blockline_t*	blocklines;
+extern int		blocklinebase;
+extern int		numblocklines;
+
 
 
 //
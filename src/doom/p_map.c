@@ -439,7 +439,7 @@ boolean P_CheckPosition(mobj_t *thing, fixed_t x, fixed_t y)
 
     for (bx = xl; bx <= xh; bx++)
         for (by = yl; by <= yh; by++)
-            if (!P_BlockThingsIterator(bx, by, PIT_CheckThing))
+            if (!P_BlockThingsBoxIterator(bx, by, tmbbox, PIT_CheckThing))
                 return false;
 
     // check lines
@@ -450,7 +450,7 @@ boolean P_CheckPosition(mobj_t *thing, fixed_t x, fixed_t y)
 
     for (bx = xl; bx <= xh; bx++)
         for (by = yl; by <= yh; by++)
-            if (!P_BlockLinesIterator(bx, by, PIT_CheckLine))
+            if (!P_BlockLinesBoxIterator(bx, by, tmbbox, PIT_CheckLine))
                 return false;
 
     return true;
@@ -1275,6 +1275,7 @@ boolean PIT_ChangeSector(mobj_t *thing)
         thing->flags &= ~MF_SOLID;
         thing->height = 0;
         thing->radius = 0;
+        P_SyncBlockThing(thing);
 
         // keep checking
         return true;
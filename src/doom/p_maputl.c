@@ -23,8 +23,12 @@
 
 
 #include <stdlib.h>
+#include <string.h>
 
 
+#include "z_zone.h"
+#include "i_system.h"
+#include "m_argv.h"
 #include "m_bbox.h"
 #include "m_misc.h"
 
@@ -333,6 +337,152 @@ void P_LineOpening (line_t* linedef)
 //
 
 
+//
+// BLOCKMAP CELL ARRAYS
+// Every cell also keeps its things in a flat array, oldest first,
+//  with each thing's position and radius copied inline, so that
+//  P_BlockThingsBoxIterator can pass over things outside its box
+//  without touching them.  An unlinked thing leaves a hole that is
+//  squeezed out when the array next fills up.
+//
+// Walked backwards the array is the bnext chain, until vanilla
+//  cross-links chains: unlinking the head of a chain with a stale
+//  position writes the head of whatever cell the stale position is
+//  in, and the chains involved then run into each other.  Linking
+//  and unlinking only ever write to the thing's neighbours and to
+//  blocklinks, so any such write that lands in a cell other than
+//  the thing's own marks just that cell diverged.  A diverged cell
+//  is walked along its chain, and is trusted again once a full walk
+//  finds the chain is its array after all.
+//
+
+//
+// MarkDiverged
+//
+static void MarkDiverged (int cellnum)
+{
+    blockcell_t*	cell = &blockcells[cellnum];
+
+    cell->diverged = true;
+    cell->changes++;
+}
+
+//
+// CheckNeighbour
+// Called before a link or unlink in cellnum writes to neighbour.
+//
+static void CheckNeighbour (int cellnum, mobj_t* neighbour)
+{
+    // Things already unlinked are in no array.
+    if (neighbour->blockcell >= 0 && neighbour->blockcell != cellnum)
+	MarkDiverged (neighbour->blockcell);
+}
+
+//
+// PackCell
+// Squeezes out the holes left by unlinked things.
+//
+static void PackCell (blockcell_t* cell)
+{
+    int		i;
+    int		j;
+
+    j = 0;
+    for (i=0 ; i<cell->numthings ; i++)
+    {
+	if (cell->things[i].mobj == NULL)
+	    continue;
+
+	cell->things[j] = cell->things[i];
+	cell->things[j].mobj->blockslot = j;
+	j++;
+    }
+
+    cell->numthings = j;
+    cell->numfree = 0;
+}
+
+//
+// GrowCell
+//
+static void GrowCell (blockcell_t* cell)
+{
+    blockthing_t*	things;
+
+    cell->maxthings = cell->maxthings ? cell->maxthings * 2 : 4;
+
+    things = Z_Malloc (cell->maxthings * sizeof(*things), PU_LEVEL, 0);
+
+    if (cell->things)
+    {
+	memcpy (things, cell->things, cell->numthings * sizeof(*things));
+	Z_Free (cell->things);
+    }
+
+    cell->things = things;
+}
+
+static void AddToCell (int cellnum, mobj_t* thing)
+{
+    blockcell_t*	cell = &blockcells[cellnum];
+    blockthing_t*	bt;
+
+    if (cell->numthings == cell->maxthings)
+    {
+	if (cell->numfree * 2 >= cell->numthings && cell->numfree > 0)
+	    PackCell (cell);
+	else
+	    GrowCell (cell);
+    }
+
+    thing->blockcell = cellnum;
+    thing->blockslot = cell->numthings;
+
+    bt = &cell->things[cell->numthings++];
+    bt->x = thing->x;
+    bt->y = thing->y;
+    bt->radius = thing->radius;
+    bt->mobj = thing;
+
+    cell->changes++;
+}
+
+static void RemoveFromCell (mobj_t* thing)
+{
+    blockcell_t*	cell = &blockcells[thing->blockcell];
+
+    cell->things[thing->blockslot].mobj = NULL;
+    cell->numfree++;
+    cell->changes++;
+
+    if (cell->numfree == cell->numthings)
+    {
+	cell->numthings = 0;
+	cell->numfree = 0;
+    }
+
+    thing->blockcell = -1;
+}
+
+//
+// P_SyncBlockThing
+// Called when a thing's position or radius is changed without
+//  relinking it, to keep its inline copy current.
+//
+void P_SyncBlockThing (mobj_t* thing)
+{
+    blockthing_t*	bt;
+
+    if ((thing->flags & MF_NOBLOCKMAP) || thing->blockcell < 0)
+	return;
+
+    bt = &blockcells[thing->blockcell].things[thing->blockslot];
+    bt->x = thing->x;
+    bt->y = thing->y;
+    bt->radius = thing->radius;
+}
+
+
 //
 // P_UnsetThingPosition
 // Unlinks a thing from block map and sectors.
@@ -344,6 +494,8 @@ void P_UnsetThingPosition (mobj_t* thing)
 {
     int		blockx;
     int		blocky;
+    int		oldcell;
+    int		cellnum;
 
     if ( ! (thing->flags & MF_NOSECTOR) )
     {
@@ -362,21 +514,47 @@ void P_UnsetThingPosition (mobj_t* thing)
     {
 	// inert things don't need to be in blockmap
 	// unlink from block map
+	oldcell = thing->blockcell;
+
+	if (oldcell >= 0)
+	    RemoveFromCell (thing);
+
+	// Vanilla leaves stale links behind when it cross-links
+	//  chains, and following them can write into another cell.
 	if (thing->bnext)
+	{
+	    CheckNeighbour (oldcell, thing->bnext);
 	    thing->bnext->bprev = thing->bprev;
+	}
 	
 	if (thing->bprev)
+	{
+	    CheckNeighbour (oldcell, thing->bprev);
 	    thing->bprev->bnext = thing->bnext;
+	}
 	else
 	{
 	    blockx = (thing->x - bmaporgx)>>MAPBLOCKSHIFT;
 	    blocky = (thing->y - bmaporgy)>>MAPBLOCKSHIFT;
+	    cellnum = -1;
 
 	    if (blockx>=0 && blockx < bmapwidth
 		&& blocky>=0 && blocky <bmapheight)
 	    {
-		blocklinks[blocky*bmapwidth+blockx] = thing->bnext;
+		cellnum = blocky*bmapwidth+blockx;
+
+		// A thing moved without being relinked takes over
+		//  the head of the cell it has moved to.
+		if (blocklinks[cellnum] != thing)
+		    MarkDiverged (cellnum);
+
+		blocklinks[cellnum] = thing->bnext;
 	    }
+
+	    // ...and leaves the cell it came from still starting
+	    //  with it.
+	    if (oldcell >= 0 && oldcell != cellnum)
+		MarkDiverged (oldcell);
 	}
     }
 }
@@ -433,14 +611,19 @@ P_SetThingPosition (mobj_t* thing)
 	    thing->bprev = NULL;
 	    thing->bnext = *link;
 	    if (*link)
+	    {
+		CheckNeighbour (blocky*bmapwidth+blockx, *link);
 		(*link)->bprev = thing;
+	    }
 
 	    *link = thing;
+	    AddToCell (blocky*bmapwidth+blockx, thing);
 	}
 	else
 	{
 	    // thing is off the map
 	    thing->bnext = thing->bprev = NULL;
+	    thing->blockcell = -1;
 	}
     }
 }
@@ -471,7 +654,7 @@ P_BlockLinesIterator
   boolean(*func)(line_t*) )
 {
     int			offset;
-    short*		list;
+    int*		list;
     line_t*		ld;
 	
     if (x<0
@@ -503,50 +686,289 @@ P_BlockLinesIterator
 
 
 //
-// P_BlockThingsIterator
+// BlockLineSide
+// P_BoxOnLineSide for a packed line.
+//
+static int BlockLineSide (fixed_t* box, blockline_t* bl)
+{
+    int		p1 = 0;
+    int		p2 = 0;
+
+    switch (bl->slopetype)
+    {
+      case ST_HORIZONTAL:
+	p1 = box[BOXTOP] > bl->y;
+	p2 = box[BOXBOTTOM] > bl->y;
+	if (bl->dx < 0)
+	{
+	    p1 ^= 1;
+	    p2 ^= 1;
+	}
+	break;
+
+      case ST_VERTICAL:
+	p1 = box[BOXRIGHT] < bl->x;
+	p2 = box[BOXLEFT] < bl->x;
+	if (bl->dy < 0)
+	{
+	    p1 ^= 1;
+	    p2 ^= 1;
+	}
+	break;
+
+      case ST_POSITIVE:
+	p1 = FixedMul (bl->dy>>FRACBITS, box[BOXLEFT] - bl->x)
+	  <= FixedMul (box[BOXTOP] - bl->y, bl->dx>>FRACBITS);
+	p2 = FixedMul (bl->dy>>FRACBITS, box[BOXRIGHT] - bl->x)
+	  <= FixedMul (box[BOXBOTTOM] - bl->y, bl->dx>>FRACBITS);
+	break;
+
+      case ST_NEGATIVE:
+	p1 = FixedMul (bl->dy>>FRACBITS, box[BOXRIGHT] - bl->x)
+	  <= FixedMul (box[BOXTOP] - bl->y, bl->dx>>FRACBITS);
+	p2 = FixedMul (bl->dy>>FRACBITS, box[BOXLEFT] - bl->x)
+	  <= FixedMul (box[BOXBOTTOM] - bl->y, bl->dx>>FRACBITS);
+	break;
+    }
+
+    if (p1 == p2)
+	return p1;
+    return -1;
+}
+
+
+//
+// P_BlockLinesBoxIterator
+// P_BlockLinesIterator for a func that passes over any line whose
+// bounding box misses box or that box lies wholly to one side of,
+// as PIT_CheckLine does.  Those lines are passed over using the
+// packed copy in blocklines, without touching line_t.  They are
+// not marked with validcount, but would only be passed over again
+// in another block.
 //
 boolean
-P_BlockThingsIterator
-( int                   x,
-  int                   y,
+P_BlockLinesBoxIterator
+( int			x,
+  int			y,
+  fixed_t*		box,
+  boolean(*func)(line_t*) )
+{
+    int			offset;
+    blockline_t*	bl;
+    line_t*		ld;
+
+    if (x<0
+	|| y<0
+	|| x>=bmapwidth
+	|| y>=bmapheight)
+    {
+	return true;
+    }
+
+    offset = blockmap[y*bmapwidth+x] - blocklinebase;
+
+    if (offset >= numblocklines)
+	return P_BlockLinesIterator (x, y, func);
+
+    for (bl = blocklines + offset ; bl->line != -1 ; bl++)
+    {
+	if (box[BOXRIGHT] <= bl->bbox[BOXLEFT]
+	 || box[BOXLEFT] >= bl->bbox[BOXRIGHT]
+	 || box[BOXTOP] <= bl->bbox[BOXBOTTOM]
+	 || box[BOXBOTTOM] >= bl->bbox[BOXTOP])
+	{
+	    continue;
+	}
+
+	if (BlockLineSide (box, bl) != -1)
+	    continue;
+
+	ld = &lines[bl->line];
+
+	if (ld->validcount == validcount)
+	    continue; 	// line has already been checked
+
+	ld->validcount = validcount;
+
+	if ( !func(ld) )
+	    return false;
+    }
+    return true;	// everything was checked
+}
+
+
+//
+// P_BlockThingsBoxIterator
+// As P_BlockThingsIterator, but passes over without calling func
+//  any thing whose box does not overlap box, edges touching.  func
+//  must return true, with no other effect, for every such thing.
+//  box may be NULL to visit everything.
+//
+boolean
+P_BlockThingsBoxIterator
+( int			x,
+  int			y,
+  fixed_t*		box,
   boolean(*func)(mobj_t*) )
 {
-    mobj_t*             mobj;
+    blockcell_t*	cell;
+    blockthing_t*	bt;
+    mobj_t*		mobj;
+    mobj_t*		prev;
+    int			cellnum;
+    int			changes;
+    int			i;
+    boolean		matches;
 
     if ( x<0
-         || y<0
-         || x>=bmapwidth
-         || y>=bmapheight)
+	 || y<0
+	 || x>=bmapwidth
+	 || y>=bmapheight)
+    {
+	return true;
+    }
+
+    cellnum = y*bmapwidth+x;
+    cell = &blockcells[cellnum];
+
+    if (!cell->diverged)
     {
-        return true;
+	// Newest first, as the chain runs.
+	changes = cell->changes;
+
+	for (i=cell->numthings-1 ; i>=0 ; i--)
+	{
+	    bt = &cell->things[i];
+
+	    if (bt->mobj == NULL)
+		continue;
+
+	    // Differences, as PIT_CheckThing takes them, so nothing
+	    //  near the edge of the map overflows.
+	    if (box != NULL
+	     && (box[BOXLEFT] - bt->x >= bt->radius
+	      || bt->x - box[BOXRIGHT] >= bt->radius
+	      || box[BOXBOTTOM] - bt->y >= bt->radius
+	      || bt->y - box[BOXTOP] >= bt->radius))
+	    {
+		continue;
+	    }
+
+	    mobj = bt->mobj;
+
+	    if (!func(mobj))
+		return false;
+
+	    // If func relinked anything here, only the chain says
+	    //  what vanilla visits next.
+	    if (cell->changes != changes)
+	    {
+		for (mobj = mobj->bnext ; mobj ; mobj = mobj->bnext)
+		{
+		    if (!func(mobj))
+			return false;
+		}
+		return true;
+	    }
+	}
+
+	return true;
     }
 
-    LINKED_LIST_CHECK_NO_CYCLE(mobj_t, blocklinks[y*bmapwidth+x], bnext);
+    LINKED_LIST_CHECK_NO_CYCLE(mobj_t, blocklinks[cellnum], bnext);
+
+    // A diverged cell is walked along its chain, which is checked
+    //  against the array on the way, back links included.  If the
+    //  whole chain matches and nothing was relinked meanwhile, the
+    //  cell can use its array again.
+    changes = cell->changes;
+    matches = true;
+    prev = NULL;
+    i = cell->numthings;
 
-    for (mobj = blocklinks[y*bmapwidth+x] ;
-         mobj ;
-         mobj = mobj->bnext)
+    for (mobj = blocklinks[cellnum] ; mobj ; mobj = mobj->bnext)
     {
-        if (!func( mobj ) )
-            return false;
+	if (matches)
+	{
+	    do
+	    {
+		i--;
+	    } while (i >= 0 && cell->things[i].mobj == NULL);
+
+	    if (i < 0 || cell->things[i].mobj != mobj || mobj->bprev != prev)
+		matches = false;
+
+	    prev = mobj;
+	}
+
+	if (!func(mobj))
+	    return false;
     }
+
+    while (matches && --i >= 0)
+    {
+	if (cell->things[i].mobj != NULL)
+	    matches = false;
+    }
+
+    if (matches && cell->changes == changes)
+	cell->diverged = false;
+
     return true;
 }
 
 
+//
+// P_BlockThingsIterator
+//
+boolean
+P_BlockThingsIterator
+( int			x,
+  int			y,
+  boolean(*func)(mobj_t*) )
+{
+    return P_BlockThingsBoxIterator (x, y, NULL, func);
+}
+
+
 
 //
 // INTERCEPT ROUTINES
 //
-intercept_t	intercepts[MAXINTERCEPTS];
+intercept_t*	intercepts;
 intercept_t*	intercept_p;
 
+static int	numinterceptsalloc;
+
 divline_t 	trace;
 boolean 	earlyout;
 int		ptflags;
 
 static void InterceptsOverrun(int num_intercepts, intercept_t *intercept);
 
+//
+// NewIntercept
+// Returns the next free slot in the intercepts table,
+//  doubling the table when it is full.
+//
+static intercept_t* NewIntercept (void)
+{
+    int		count;
+
+    count = intercept_p - intercepts;
+
+    if (count == numinterceptsalloc)
+    {
+	numinterceptsalloc = numinterceptsalloc ? numinterceptsalloc * 2
+						: MAXINTERCEPTS_ORIGINAL;
+	intercepts = I_Realloc(intercepts,
+			       numinterceptsalloc * sizeof(*intercepts));
+	intercept_p = intercepts + count;
+    }
+
+    return intercept_p;
+}
+
 //
 // PIT_AddLineIntercepts.
 // Looks for lines in the given block
@@ -557,13 +979,13 @@ static void InterceptsOverrun(int num_intercepts, intercept_t *intercept);
 // are on opposite sides of the trace.
 // Returns true if earlyout and a solid line hit.
 //
+static boolean AddLineIntercept (line_t* ld);
+
 boolean
 PIT_AddLineIntercepts (line_t* ld)
 {
     int			s1;
     int			s2;
-    fixed_t		frac;
-    divline_t		dl;
 	
     // avoid precision problems with two routines
     if ( trace.dx > FRACUNIT*16
@@ -583,6 +1005,19 @@ PIT_AddLineIntercepts (line_t* ld)
     if (s1 == s2)
 	return true;	// line isn't crossed
     
+    return AddLineIntercept (ld);
+}
+
+
+//
+// AddLineIntercept
+// Adds a line already known to cross the trace.
+//
+static boolean AddLineIntercept (line_t* ld)
+{
+    fixed_t		frac;
+    divline_t		dl;
+
     // hit the line
     P_MakeDivline (ld, &dl);
     frac = P_InterceptVector (&trace, &dl);
@@ -599,6 +1034,7 @@ PIT_AddLineIntercepts (line_t* ld)
     }
     
 	
+    NewIntercept();
     intercept_p->frac = frac;
     intercept_p->isaline = true;
     intercept_p->d.line = ld;
@@ -613,6 +1049,203 @@ PIT_AddLineIntercepts (line_t* ld)
 //
 // PIT_AddThingIntercepts
 //
+//
+// BATCHED LINE INTERCEPTS
+// P_PathTraverse side-tests the lines of a block a batch at a
+//  time.  The tests are the same integer arithmetic as
+//  P_PointOnDivlineSide and P_PointOnLineSide, written without
+//  branches over small arrays so that the compiler can vectorise
+//  them; the crossed lines are then added one by one, in block
+//  order, exactly as PIT_AddLineIntercepts would.
+//
+#define LINEBATCH	8
+
+// Sides of a batch of points against the trace, as
+//  P_PointOnDivlineSide, for a trace with nonzero dx and dy.
+//  Always a whole batch, so the loop has a fixed trip count.
+static void DivlineSides
+( const fixed_t*	x,
+  const fixed_t*	y,
+  int*			side )
+{
+    fixed_t	dx;
+    fixed_t	dy;
+    fixed_t	left;
+    fixed_t	right;
+    int		quick;
+    int		i;
+
+    for (i=0 ; i<LINEBATCH ; i++)
+    {
+	dx = x[i] - trace.x;
+	dy = y[i] - trace.y;
+
+	left = ((int64_t) (trace.dy>>8) * (dx>>8)) >> FRACBITS;
+	right = ((int64_t) (dy>>8) * (trace.dx>>8)) >> FRACBITS;
+
+	// the sign bit test decides it when it can
+	quick = ((trace.dy ^ trace.dx ^ dx ^ dy) & 0x80000000) != 0;
+
+	side[i] = quick ? ((trace.dy ^ dx) & 0x80000000) != 0
+	                : !(right < left);
+    }
+}
+
+// Sides of one point against a batch of lines, as
+//  P_PointOnLineSide.
+static void LineSides
+( fixed_t		x,
+  fixed_t		y,
+  const fixed_t*	lx,
+  const fixed_t*	ly,
+  const fixed_t*	ldx,
+  const fixed_t*	ldy,
+  int*			side )
+{
+    fixed_t	dx;
+    fixed_t	dy;
+    fixed_t	left;
+    fixed_t	right;
+    int		vertical;
+    int		horizontal;
+    int		i;
+
+    for (i=0 ; i<LINEBATCH ; i++)
+    {
+	dx = x - lx[i];
+	dy = y - ly[i];
+
+	left = ((int64_t) (ldy[i]>>FRACBITS) * dx) >> FRACBITS;
+	right = ((int64_t) dy * (ldx[i]>>FRACBITS)) >> FRACBITS;
+
+	vertical = x <= lx[i] ? ldy[i] > 0 : ldy[i] < 0;
+	horizontal = y <= ly[i] ? ldx[i] < 0 : ldx[i] > 0;
+
+	side[i] = !ldx[i] ? vertical
+	        : !ldy[i] ? horizontal
+	        : !(right < left);
+    }
+}
+
+//
+// AddLineBatch
+// Returns false if earlyout and a solid line was hit.
+//
+static boolean AddLineBatch (line_t** batch, int count)
+{
+    fixed_t	x1[LINEBATCH];
+    fixed_t	y1[LINEBATCH];
+    fixed_t	x2[LINEBATCH];
+    fixed_t	y2[LINEBATCH];
+    fixed_t	ldx[LINEBATCH];
+    fixed_t	ldy[LINEBATCH];
+    int		s1[LINEBATCH];
+    int		s2[LINEBATCH];
+    line_t*	ld;
+    int		i;
+
+    if (count == 0)
+	return true;
+
+    // Pad a short batch with copies of its first line.
+    for (i=0 ; i<LINEBATCH ; i++)
+    {
+	ld = batch[i < count ? i : 0];
+	x1[i] = ld->v1->x;
+	y1[i] = ld->v1->y;
+	x2[i] = ld->v2->x;
+	y2[i] = ld->v2->y;
+	ldx[i] = ld->dx;
+	ldy[i] = ld->dy;
+    }
+
+    // avoid precision problems with two routines
+    if ( trace.dx > FRACUNIT*16
+	 || trace.dy > FRACUNIT*16
+	 || trace.dx < -FRACUNIT*16
+	 || trace.dy < -FRACUNIT*16)
+    {
+	if (!trace.dx || !trace.dy)
+	{
+	    // axis-aligned traces are rare; no need to batch them
+	    for (i=0 ; i<count ; i++)
+	    {
+		s1[i] = P_PointOnDivlineSide (x1[i], y1[i], &trace);
+		s2[i] = P_PointOnDivlineSide (x2[i], y2[i], &trace);
+	    }
+	}
+	else
+	{
+	    DivlineSides (x1, y1, s1);
+	    DivlineSides (x2, y2, s2);
+	}
+    }
+    else
+    {
+	LineSides (trace.x, trace.y, x1, y1, ldx, ldy, s1);
+	LineSides (trace.x+trace.dx, trace.y+trace.dy,
+		   x1, y1, ldx, ldy, s2);
+    }
+
+    for (i=0 ; i<count ; i++)
+    {
+	if (s1[i] != s2[i] && !AddLineIntercept (batch[i]))
+	    return false;
+    }
+
+    return true;
+}
+
+//
+// AddBlockLineIntercepts
+// P_BlockLinesIterator with PIT_AddLineIntercepts, a batch
+//  at a time.
+//
+static boolean AddBlockLineIntercepts (int x, int y)
+{
+    line_t*	batch[LINEBATCH];
+    int		count;
+    int		offset;
+    int*	list;
+    line_t*	ld;
+
+    if (x<0
+	|| y<0
+	|| x>=bmapwidth
+	|| y>=bmapheight)
+    {
+	return true;
+    }
+
+    offset = y*bmapwidth+x;
+
+    offset = *(blockmap+offset);
+
+    count = 0;
+
+    for ( list = blockmaplump+offset ; *list != -1 ; list++)
+    {
+	ld = &lines[*list];
+
+	if (ld->validcount == validcount)
+	    continue; 	// line has already been checked
+
+	ld->validcount = validcount;
+
+	batch[count++] = ld;
+
+	if (count == LINEBATCH)
+	{
+	    if (!AddLineBatch (batch, count))
+		return false;
+	    count = 0;
+	}
+    }
+
+    return AddLineBatch (batch, count);
+}
+
+
 boolean PIT_AddThingIntercepts (mobj_t* thing)
 {
     fixed_t		x1;
@@ -665,6 +1298,7 @@ boolean PIT_AddThingIntercepts (mobj_t* thing)
     if (frac < 0)
 	return true;		// behind source
 
+    NewIntercept();
     intercept_p->frac = frac;
     intercept_p->isaline = false;
     intercept_p->d.thing = thing;
@@ -675,6 +1309,38 @@ boolean PIT_AddThingIntercepts (mobj_t* thing)
 }
 
 
+//
+// SortIntercepts
+// Stable insertion sort by frac.  Intercepts are found block by
+//  block along the trace, so the table is nearly in order already.
+//  Equal fracs keep the order they were added in, which is the
+//  order the old repeated minimum scan visited them in.
+//
+static void SortIntercepts (void)
+{
+    intercept_t*	scan;
+    intercept_t*	in;
+    intercept_t		t;
+
+    for (scan = intercepts + 1 ; scan < intercept_p ; scan++)
+    {
+	if (scan->frac >= scan[-1].frac)
+	    continue;
+
+	t = *scan;
+	in = scan;
+
+	do
+	{
+	    *in = in[-1];
+	    in--;
+	} while (in > intercepts && t.frac < in[-1].frac);
+
+	*in = t;
+    }
+}
+
+
 //
 // P_TraverseIntercepts
 // Returns true if the traverser function returns true
@@ -685,48 +1351,26 @@ P_TraverseIntercepts
 ( traverser_t	func,
   fixed_t	maxfrac )
 {
-    int			count;
-    fixed_t		dist;
-    intercept_t*	scan;
     intercept_t*	in;
-	
-    count = intercept_p - intercepts;
-    
-    in = 0;			// shut up compiler warning
-	
-    while (count--)
-    {
-	dist = INT_MAX;
-	for (scan = intercepts ; scan<intercept_p ; scan++)
-	{
-	    if (scan->frac < dist)
-	    {
-		dist = scan->frac;
-		in = scan;
-	    }
-	}
-	
-	if (dist > maxfrac)
-	    return true;	// checked everything in range		
+    int			i;
+
+    SortIntercepts ();
 
-#if 0  // UNUSED
+    // A traverser can start another trace, which may grow and so
+    //  move the table, so it is walked by index and looked up again
+    //  after every call.  Vanilla's fixed table was only overwritten,
+    //  and the same index into the new contents is what it read next.
+    for (i = 0 ; intercepts + i < intercept_p ; i++)
     {
-	// don't check these yet, there may be others inserted
-	in = scan = intercepts;
-	for ( scan = intercepts ; scan<intercept_p ; scan++)
-	    if (scan->frac > maxfrac)
-		*in++ = *scan;
-	intercept_p = in;
-	return false;
-    }
-#endif
+	in = &intercepts[i];
+
+	if (in->frac > maxfrac)
+	    return true;	// checked everything in range
 
         if ( !func (in) )
 	    return false;	// don't bother going farther
-
-	in->frac = INT_MAX;
     }
-	
+
     return true;		// everything was traversed
 }
 
@@ -827,6 +1471,7 @@ static void InterceptsMemoryOverrun(int location, int value)
 
 static void InterceptsOverrun(int num_intercepts, intercept_t *intercept)
 {
+    static int emulate = -1;
     int location;
 
     if (num_intercepts <= MAXINTERCEPTS_ORIGINAL)
@@ -836,6 +1481,24 @@ static void InterceptsOverrun(int num_intercepts, intercept_t *intercept)
         return;
     }
 
+    if (emulate < 0)
+    {
+        //!
+        // @category compat
+        //
+        // Emulate the memory overwritten when a trace finds more than
+        // 128 intercepts, as Vanilla Doom does.  Needed to play back
+        // some Vanilla demos recorded on large open maps.
+        //
+
+        emulate = M_ParmExists("-interceptsoverrun");
+    }
+
+    if (!emulate)
+    {
+        return;
+    }
+
     location = (num_intercepts - MAXINTERCEPTS_ORIGINAL - 1) * 12;
 
     // Overwrite memory that is overwritten in Vanilla Doom, using
@@ -962,11 +1625,11 @@ P_PathTraverse
     mapx = xt1;
     mapy = yt1;
 	
-    for (count = 0 ; count < 64 ; count++)
+    for (count = 0 ; count < 64 * 128 / MAPBLOCKUNITS ; count++)
     {
 	if (flags & PT_ADDLINES)
 	{
-	    if (!P_BlockLinesIterator (mapx, mapy,PIT_AddLineIntercepts))
+	    if (!AddBlockLineIntercepts (mapx, mapy))
 		return false;	// early out
 	}
 	
@@ -55,6 +55,9 @@ boolean P_SetMobjState(mobj_t *mobj, statenum_t state)
     state_t *st;
     int cycle_counter = 0;
 
+    if (mobj->thinker.waketic)
+        P_WakeThinker(&mobj->thinker);
+
     do
     {
         if (state == S_NULL)
@@ -455,6 +458,35 @@ void P_MobjThinker(mobj_t *mobj)
 }
 
 
+//
+// P_MobjIdleTics
+// Returns how many of the mobj's next turns would do nothing but
+// count down its tics, or -1 if nothing short of being disturbed
+// will ever give it anything to do.
+//
+int P_MobjIdleTics(mobj_t *mobj)
+{
+    if (mobj->player
+     || mobj->momx || mobj->momy || mobj->momz
+     || (mobj->flags & MF_SKULLFLY)
+     || mobj->z != mobj->floorz)
+    {
+        return 0;
+    }
+
+    if (mobj->tics == -1)
+    {
+        // Corpses count towards a nightmare respawn.
+        if ((mobj->flags & MF_COUNTKILL) && respawnmonsters)
+            return 0;
+
+        return -1;
+    }
+
+    return mobj->tics - 1;
+}
+
+
 //
 // P_SpawnMobj
 //
@@ -464,7 +496,7 @@ mobj_t *P_SpawnMobj(fixed_t x, fixed_t y, fixed_t z, mobjtype_t type)
     state_t *st;
     mobjinfo_t *info;
 
-    mobj = Z_Malloc(sizeof(*mobj), PU_LEVEL, NULL);
+    mobj = P_AllocateThinker(sizeof(*mobj), PU_LEVEL);
     memset(mobj, 0, sizeof(*mobj));
     info = &mobjinfo[type];
 
@@ -505,7 +537,7 @@ mobj_t *P_SpawnMobj(fixed_t x, fixed_t y, fixed_t z, mobjtype_t type)
 
     mobj->thinker.function.acp1 = (actionf_p1) P_MobjThinker;
 
-    P_AddThinker(&mobj->thinker);
+    P_AddThinker(&mobj->thinker, th_mobj);
 
     return mobj;
 }
@@ -852,6 +884,7 @@ void P_CheckMissileSpawn(mobj_t *th)
     // be computed if it immediately explodes
     th->x += (th->momx >> 1);
     th->y += (th->momy >> 1);
+    P_SyncBlockThing(th);
     th->z += (th->momz >> 1);
 
     if (!P_TryMove(th, th->x, th->y))
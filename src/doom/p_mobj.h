@@ -203,30 +203,21 @@ typedef struct mobj_s
     // List: thinker links.
     thinker_t		thinker;
 
+    // The fields up to target are the ones movement and the
+    //  blockmap iterators look at, kept together so that
+    //  collision checks touch as few cache lines as possible.
+    //  x, y and z must stay first to match degenmobj_t.
+
     // Info for drawing: position.
     fixed_t		x;
     fixed_t		y;
     fixed_t		z;
 
-    // More list: links in sector (if needed)
-    struct mobj_s*	snext;
-    struct mobj_s*	sprev;
-
-    //More drawing info: to determine current sprite.
-    angle_t		angle;	// orientation
-    spritenum_t		sprite;	// used to find patch_t and flip value
-    int			frame;	// might be ORed with FF_FULLBRIGHT
+    int			flags;
 
     // Interaction info, by BLOCKMAP.
     // Links in blocks (if needed).
     struct mobj_s*	bnext;
-    struct mobj_s*	bprev;
-    
-    struct subsector_s*	subsector;
-
-    // The closest interval over all contacted Sectors.
-    fixed_t		floorz;
-    fixed_t		ceilingz;
 
     // For movement checking.
     fixed_t		radius;
@@ -237,25 +228,42 @@ typedef struct mobj_s
     fixed_t		momy;
     fixed_t		momz;
 
+    // The closest interval over all contacted Sectors.
+    fixed_t		floorz;
+    fixed_t		ceilingz;
+
     // If == validcount, already checked.
     int			validcount;
 
+    struct mobj_s*	bprev;
+    
+    struct subsector_s*	subsector;
+
     mobjtype_t		type;
+    int			health;
+
+    // Thing being chased/attacked (or NULL),
+    // also the originator for missiles.
+    struct mobj_s*	target;
+
+    // More list: links in sector (if needed)
+    struct mobj_s*	snext;
+    struct mobj_s*	sprev;
+
+    //More drawing info: to determine current sprite.
+    angle_t		angle;	// orientation
+    spritenum_t		sprite;	// used to find patch_t and flip value
+    int			frame;	// might be ORed with FF_FULLBRIGHT
+
     mobjinfo_t*		info;	// &mobjinfo[mobj->type]
     
     int			tics;	// state tic counter
     state_t*		state;
-    int			flags;
-    int			health;
 
     // Movement direction, movement generation (zig-zagging).
     int			movedir;	// 0-7
     int			movecount;	// when 0, select a new dir
 
-    // Thing being chased/attacked (or NULL),
-    // also the originator for missiles.
-    struct mobj_s*	target;
-
     // Reaction time: if non 0, don't attack yet.
     // Used by player to freeze a bit after teleporting.
     int			reactiontime;   
@@ -276,6 +284,11 @@ typedef struct mobj_s
 
     // Thing being chased/attacked for tracers.
     struct mobj_s*	tracer;	
+
+    // Blockmap cell whose array holds this thing, or -1,
+    //  and its slot in that array.
+    int			blockcell;
+    int			blockslot;
     
 } mobj_t;
 
@@ -1589,19 +1589,18 @@ void P_ArchiveThinkers (void)
 {
     thinker_t*		th;
 
+    // Sleeping mobjs only have their tics brought up to date
+    //  when they wake.
+    P_WakeAllThinkers ();
+
     // save off the current thinkers
-    for (th = thinkercap.next ; th != &thinkercap ; th=th->next)
+    for (th = thinkerclasscap[th_mobj].cnext ;
+         th != &thinkerclasscap[th_mobj] ;
+         th = th->cnext)
     {
-	if (th->function.acp1 == (actionf_p1)P_MobjThinker)
-	{
-            saveg_write8(tc_mobj);
-	    saveg_write_pad();
-            saveg_write_mobj_t((mobj_t *) th);
-
-	    continue;
-	}
-		
-	// I_Error ("P_ArchiveThinkers: Unknown thinker function");
+        saveg_write8(tc_mobj);
+        saveg_write_pad();
+        saveg_write_mobj_t((mobj_t *) th);
     }
 
     // add a terminating marker
@@ -1621,6 +1620,7 @@ void P_UnArchiveThinkers (void)
     mobj_t*		mobj;
     
     // remove all the current thinkers
+    P_WakeAllThinkers ();
     currentthinker = thinkercap.next;
     while (currentthinker != &thinkercap)
     {
@@ -1629,7 +1629,7 @@ void P_UnArchiveThinkers (void)
 	if (currentthinker->function.acp1 == (actionf_p1)P_MobjThinker)
 	    P_RemoveMobj ((mobj_t *)currentthinker);
 	else
-	    Z_Free (currentthinker);
+	    P_FreeThinker (currentthinker);
 
 	currentthinker = next;
     }
@@ -1646,7 +1646,7 @@ void P_UnArchiveThinkers (void)
 			
 	  case tc_mobj:
 	    saveg_read_pad();
-	    mobj = Z_Malloc (sizeof(*mobj), PU_LEVEL, NULL);
+	    mobj = P_AllocateThinker (sizeof(*mobj), PU_LEVEL);
             saveg_read_mobj_t(mobj);
 
 	    mobj->target = NULL;
@@ -1656,7 +1656,7 @@ void P_UnArchiveThinkers (void)
 	    mobj->floorz = mobj->subsector->sector->floorheight;
 	    mobj->ceilingz = mobj->subsector->sector->ceilingheight;
 	    mobj->thinker.function.acp1 = (actionf_p1)P_MobjThinker;
-	    P_AddThinker (&mobj->thinker);
+	    P_AddThinker (&mobj->thinker, th_mobj);
 	    break;
 
 	  default:
@@ -1810,70 +1810,70 @@ void P_UnArchiveSpecials (void)
 			
 	  case tc_ceiling:
 	    saveg_read_pad();
-	    ceiling = Z_Malloc (sizeof(*ceiling), PU_LEVEL, NULL);
+	    ceiling = P_AllocateThinker (sizeof(*ceiling), PU_LEVEL);
             saveg_read_ceiling_t(ceiling);
 	    ceiling->sector->specialdata = ceiling;
 
 	    if (ceiling->thinker.function.acp1)
 		ceiling->thinker.function.acp1 = (actionf_p1)T_MoveCeiling;
 
-	    P_AddThinker (&ceiling->thinker);
+	    P_AddThinker (&ceiling->thinker, th_mover);
 	    P_AddActiveCeiling(ceiling);
 	    break;
 				
 	  case tc_door:
 	    saveg_read_pad();
-	    door = Z_Malloc (sizeof(*door), PU_LEVEL, NULL);
+	    door = P_AllocateThinker (sizeof(*door), PU_LEVEL);
             saveg_read_vldoor_t(door);
 	    door->sector->specialdata = door;
 	    door->thinker.function.acp1 = (actionf_p1)T_VerticalDoor;
-	    P_AddThinker (&door->thinker);
+	    P_AddThinker (&door->thinker, th_mover);
 	    break;
 				
 	  case tc_floor:
 	    saveg_read_pad();
-	    floor = Z_Malloc (sizeof(*floor), PU_LEVEL, NULL);
+	    floor = P_AllocateThinker (sizeof(*floor), PU_LEVEL);
             saveg_read_floormove_t(floor);
 	    floor->sector->specialdata = floor;
 	    floor->thinker.function.acp1 = (actionf_p1)T_MoveFloor;
-	    P_AddThinker (&floor->thinker);
+	    P_AddThinker (&floor->thinker, th_mover);
 	    break;
 				
 	  case tc_plat:
 	    saveg_read_pad();
-	    plat = Z_Malloc (sizeof(*plat), PU_LEVEL, NULL);
+	    plat = P_AllocateThinker (sizeof(*plat), PU_LEVEL);
             saveg_read_plat_t(plat);
 	    plat->sector->specialdata = plat;
 
 	    if (plat->thinker.function.acp1)
 		plat->thinker.function.acp1 = (actionf_p1)T_PlatRaise;
 
-	    P_AddThinker (&plat->thinker);
+	    P_AddThinker (&plat->thinker, th_mover);
 	    P_AddActivePlat(plat);
 	    break;
 				
 	  case tc_flash:
 	    saveg_read_pad();
-	    flash = Z_Malloc (sizeof(*flash), PU_LEVEL, NULL);
+	    flash = P_AllocateThinker (sizeof(*flash), PU_LEVEL);
             saveg_read_lightflash_t(flash);
 	    flash->thinker.function.acp1 = (actionf_p1)T_LightFlash;
-	    P_AddThinker (&flash->thinker);
+	    P_AddThinker (&flash->thinker, th_light);
 	    break;
 				
 	  case tc_strobe:
 	    saveg_read_pad();
-	    strobe = Z_Malloc (sizeof(*strobe), PU_LEVEL, NULL);
+	    strobe = P_AllocateThinker (sizeof(*strobe), PU_LEVEL);
             saveg_read_strobe_t(strobe);
 	    strobe->thinker.function.acp1 = (actionf_p1)T_StrobeFlash;
-	    P_AddThinker (&strobe->thinker);
+	    P_AddThinker (&strobe->thinker, th_light);
 	    break;
 				
 	  case tc_glow:
 	    saveg_read_pad();
-	    glow = Z_Malloc (sizeof(*glow), PU_LEVEL, NULL);
+	    glow = P_AllocateThinker (sizeof(*glow), PU_LEVEL);
             saveg_read_glow_t(glow);
 	    glow->thinker.function.acp1 = (actionf_p1)T_Glow;
-	    P_AddThinker (&glow->thinker);
+	    P_AddThinker (&glow->thinker, th_light);
 	    break;
 				
 	  default:
@@ -22,11 +22,19 @@
 #include <math.h>
 #include <stdlib.h>
 
+#ifdef HAVE_LIBZ
+#include <zlib.h>
+#endif
+
 #include "z_zone.h"
 
+#include "i_jobs.h"
 #include "i_swap.h"
+#include "i_timer.h"
 #include "m_argv.h"
 #include "m_bbox.h"
+#include "m_config.h"
+#include "sha1.h"
 
 #include "g_game.h"
 
@@ -42,8 +50,15 @@
 
 #include "m_misc.h"
 
+#include "r_pvs.h"
+
 void	P_SpawnMapThing (mapthing_t*	mthing);
 
+// Not part of ISO C, and missing from <math.h> on some compilers.
+#ifndef M_PI
+#define M_PI		3.14159265358979323846
+#endif
+
 
 //
 // MAP related Lookup tables.
@@ -82,14 +97,22 @@ static int      totallines;
 // Blockmap size.
 int		bmapwidth;
 int		bmapheight;	// size in mapblocks
-short*		blockmap;	// int for larger maps
+int*		blockmap;	// int for larger maps
 // offsets in blockmap are from here
-short*		blockmaplump;		
+int*		blockmaplump;		
 // origin of block map
 fixed_t		bmaporgx;
 fixed_t		bmaporgy;
 // for thing chains
 mobj_t**	blocklinks;		
+blockcell_t*	blockcells;
+// for PIT_CheckLine
+blockline_t*	blocklines;
+int		blocklinebase;
+int		numblocklines;
+
+// length of blockmaplump
+static int	blockmapsize;
 
 
 // REJECT
@@ -114,16 +137,66 @@ boolean     playerstartsingame[MAXPLAYERS];
 
 
 
+//
+// LEVEL LOADING
+// Each P_Load* function runs on the main thread: it sizes and
+//  allocates its array and caches its lump.  The records are
+//  decoded afterwards by a pass over ranges of records, run as
+//  jobs.  A pass only reads arrays whose own passes are finished,
+//  so they run in three batches: everything but the linedefs and
+//  segs first, then the linedefs, which need the vertexes and
+//  sidedefs, then the segs, which need the linedefs.
+//
+typedef enum
+{
+    LP_BLOCKMAP,
+    LP_VERTEXES,
+    LP_SECTORS,
+    LP_SIDEDEFS,
+    LP_SUBSECTORS,
+    LP_NODES,
+    LP_LINEDEFS,
+    LP_SEGS,
+    NUMLOADPASSES
+
+} loadpass_t;
+
+// Records decoded per job.
+#define LOADCHUNK	1024
+
+// A range of records of one pass.  Decoders cannot call I_Error
+//  off the main thread, so errors are kept here and raised by
+//  RunLoadPasses in load order.
+typedef struct
+{
+    loadpass_t	pass;
+    int		start;
+    int		end;
+    char	error[80];
+
+} loadjob_t;
+
+static byte*	passdata[NUMLOADPASSES];
+static int	passlump[NUMLOADPASSES];
+static int	passcount[NUMLOADPASSES];
+
+
+//
+// CachePass
+//
+static void CachePass (loadpass_t pass, int lump, int count)
+{
+    passdata[pass] = W_CacheLumpNum (lump, PU_STATIC);
+    passlump[pass] = lump;
+    passcount[pass] = count;
+}
+
+
 //
 // P_LoadVertexes
 //
 void P_LoadVertexes (int lump)
 {
-    byte*		data;
-    int			i;
-    mapvertex_t*	ml;
-    vertex_t*		li;
-
     // Determine number of lumps:
     //  total lump length / vertex record length.
     numvertexes = W_LumpLength (lump) / sizeof(mapvertex_t);
@@ -132,21 +205,25 @@ void P_LoadVertexes (int lump)
     vertexes = Z_Malloc (numvertexes*sizeof(vertex_t),PU_LEVEL,0);	
 
     // Load data into cache.
-    data = W_CacheLumpNum (lump, PU_STATIC);
-	
-    ml = (mapvertex_t *)data;
-    li = vertexes;
+    CachePass (LP_VERTEXES, lump, numvertexes);
+}
+
+static void DecodeVertexes (loadjob_t* job)
+{
+    int			i;
+    mapvertex_t*	ml;
+    vertex_t*		li;
+
+    ml = (mapvertex_t *)passdata[LP_VERTEXES] + job->start;
+    li = vertexes + job->start;
 
     // Copy and convert vertex coordinates,
     // internal representation as fixed.
-    for (i=0 ; i<numvertexes ; i++, li++, ml++)
+    for (i=job->start ; i<job->end ; i++, li++, ml++)
     {
 	li->x = SHORT(ml->x)<<FRACBITS;
 	li->y = SHORT(ml->y)<<FRACBITS;
     }
-
-    // Free buffer memory.
-    W_ReleaseLumpNum(lump);
 }
 
 //
@@ -173,70 +250,96 @@ sector_t* GetSectorAtNullAddress(void)
 //
 void P_LoadSegs (int lump)
 {
-    byte*		data;
-    int			i;
-    mapseg_t*		ml;
-    seg_t*		li;
-    line_t*		ldef;
-    int			linedef;
-    int			side;
-    int                 sidenum;
-	
     numsegs = W_LumpLength (lump) / sizeof(mapseg_t);
     segs = Z_Malloc (numsegs*sizeof(seg_t),PU_LEVEL,0);	
-    memset (segs, 0, numsegs*sizeof(seg_t));
-    data = W_CacheLumpNum (lump,PU_STATIC);
-	
-    ml = (mapseg_t *)data;
-    li = segs;
-    for (i=0 ; i<numsegs ; i++, li++, ml++)
-    {
-	li->v1 = &vertexes[SHORT(ml->v1)];
-	li->v2 = &vertexes[SHORT(ml->v2)];
 
-	li->angle = (SHORT(ml->angle))<<FRACBITS;
-	li->offset = (SHORT(ml->offset))<<FRACBITS;
-	linedef = SHORT(ml->linedef);
-	ldef = &lines[linedef];
-	li->linedef = ldef;
-	side = SHORT(ml->side);
+    // Set up the null sector here, before the decoders share it.
+    GetSectorAtNullAddress ();
 
-        // e6y: check for wrong indexes
-        if ((unsigned)ldef->sidenum[side] >= (unsigned)numsides)
-        {
-            I_Error("P_LoadSegs: linedef %d for seg %d references a non-existent sidedef %d",
-                    linedef, i, (unsigned)ldef->sidenum[side]);
-        }
+    CachePass (LP_SEGS, lump, numsegs);
+}
 
-	li->sidedef = &sides[ldef->sidenum[side]];
-	li->frontsector = sides[ldef->sidenum[side]].sector;
+//
+// SetSegSides
+// Fills in the sidedef and sectors of a seg from its linedef.
+//
+static boolean
+SetSegSides
+( loadjob_t*	job,
+  seg_t*	li,
+  int		segnum,
+  int		linedef,
+  int		side )
+{
+    line_t*		ldef;
+    int                 sidenum;
 
-        if (ldef-> flags & ML_TWOSIDED)
-        {
-            sidenum = ldef->sidenum[side ^ 1];
+    ldef = &lines[linedef];
+    li->linedef = ldef;
 
-            // If the sidenum is out of range, this may be a "glass hack"
-            // impassible window.  Point at side #0 (this may not be
-            // the correct Vanilla behavior; however, it seems to work for
-            // OTTAWAU.WAD, which is the one place I've seen this trick
-            // used).
+    // e6y: check for wrong indexes
+    if ((unsigned)ldef->sidenum[side] >= (unsigned)numsides)
+    {
+        M_snprintf(job->error, sizeof(job->error),
+                   "P_LoadSegs: linedef %d for seg %d references a non-existent sidedef %d",
+                   linedef, segnum, (unsigned)ldef->sidenum[side]);
+        return false;
+    }
 
-            if (sidenum < 0 || sidenum >= numsides)
-            {
-                li->backsector = GetSectorAtNullAddress();
-            }
-            else
-            {
-                li->backsector = sides[sidenum].sector;
-            }
+    li->sidedef = &sides[ldef->sidenum[side]];
+    li->frontsector = sides[ldef->sidenum[side]].sector;
+
+    if (ldef-> flags & ML_TWOSIDED)
+    {
+        sidenum = ldef->sidenum[side ^ 1];
+
+        // If the sidenum is out of range, this may be a "glass hack"
+        // impassible window.  Point at side #0 (this may not be
+        // the correct Vanilla behavior; however, it seems to work for
+        // OTTAWAU.WAD, which is the one place I've seen this trick
+        // used).
+
+        if (sidenum < 0 || sidenum >= numsides)
+        {
+            li->backsector = GetSectorAtNullAddress();
         }
         else
         {
-	    li->backsector = 0;
+            li->backsector = sides[sidenum].sector;
         }
     }
+    else
+    {
+        li->backsector = 0;
+    }
+
+    return true;
+}
+
+static void DecodeSegs (loadjob_t* job)
+{
+    int			i;
+    mapseg_t*		ml;
+    seg_t*		li;
 	
-    W_ReleaseLumpNum(lump);
+    ml = (mapseg_t *)passdata[LP_SEGS] + job->start;
+    li = segs + job->start;
+    memset (li, 0, (job->end - job->start)*sizeof(seg_t));
+
+    for (i=job->start ; i<job->end ; i++, li++, ml++)
+    {
+	li->v1 = &vertexes[(unsigned short) SHORT(ml->v1)];
+	li->v2 = &vertexes[(unsigned short) SHORT(ml->v2)];
+
+	li->angle = (SHORT(ml->angle))<<FRACBITS;
+	li->offset = (SHORT(ml->offset))<<FRACBITS;
+
+	if (!SetSegSides(job, li, i, (unsigned short) SHORT(ml->linedef),
+			 SHORT(ml->side)))
+	{
+	    return;
+	}
+    }
 }
 
 
@@ -245,26 +348,26 @@ void P_LoadSegs (int lump)
 //
 void P_LoadSubsectors (int lump)
 {
-    byte*		data;
+    numsubsectors = W_LumpLength (lump) / sizeof(mapsubsector_t);
+    subsectors = Z_Malloc (numsubsectors*sizeof(subsector_t),PU_LEVEL,0);	
+    CachePass (LP_SUBSECTORS, lump, numsubsectors);
+}
+
+static void DecodeSubsectors (loadjob_t* job)
+{
     int			i;
     mapsubsector_t*	ms;
     subsector_t*	ss;
 	
-    numsubsectors = W_LumpLength (lump) / sizeof(mapsubsector_t);
-    subsectors = Z_Malloc (numsubsectors*sizeof(subsector_t),PU_LEVEL,0);	
-    data = W_CacheLumpNum (lump,PU_STATIC);
-	
-    ms = (mapsubsector_t *)data;
-    memset (subsectors,0, numsubsectors*sizeof(subsector_t));
-    ss = subsectors;
+    ms = (mapsubsector_t *)passdata[LP_SUBSECTORS] + job->start;
+    ss = subsectors + job->start;
+    memset (ss, 0, (job->end - job->start)*sizeof(subsector_t));
     
-    for (i=0 ; i<numsubsectors ; i++, ss++, ms++)
+    for (i=job->start ; i<job->end ; i++, ss++, ms++)
     {
-	ss->numlines = SHORT(ms->numsegs);
-	ss->firstline = SHORT(ms->firstseg);
+	ss->numlines = (unsigned short) SHORT(ms->numsegs);
+	ss->firstline = (unsigned short) SHORT(ms->firstseg);
     }
-	
-    W_ReleaseLumpNum(lump);
 }
 
 
@@ -274,31 +377,53 @@ void P_LoadSubsectors (int lump)
 //
 void P_LoadSectors (int lump)
 {
-    byte*		data;
+    numsectors = W_LumpLength (lump) / sizeof(mapsector_t);
+    sectors = Z_Malloc (numsectors*sizeof(sector_t),PU_LEVEL,0);	
+    CachePass (LP_SECTORS, lump, numsectors);
+}
+
+//
+// FlatNumForName
+// R_FlatNumForName, with the error kept in the job.
+//
+static int FlatNumForName (loadjob_t* job, const char* name)
+{
+    int		i;
+
+    i = W_CheckNumForName (name);
+
+    if (i == -1 && job->error[0] == '\0')
+    {
+	M_snprintf (job->error, sizeof(job->error),
+		    "R_FlatNumForName: %.8s not found", name);
+    }
+    return i - firstflat;
+}
+
+static void DecodeSectors (loadjob_t* job)
+{
     int			i;
     mapsector_t*	ms;
     sector_t*		ss;
 	
-    numsectors = W_LumpLength (lump) / sizeof(mapsector_t);
-    sectors = Z_Malloc (numsectors*sizeof(sector_t),PU_LEVEL,0);	
-    memset (sectors, 0, numsectors*sizeof(sector_t));
-    data = W_CacheLumpNum (lump,PU_STATIC);
-	
-    ms = (mapsector_t *)data;
-    ss = sectors;
-    for (i=0 ; i<numsectors ; i++, ss++, ms++)
+    ms = (mapsector_t *)passdata[LP_SECTORS] + job->start;
+    ss = sectors + job->start;
+    memset (ss, 0, (job->end - job->start)*sizeof(sector_t));
+
+    for (i=job->start ; i<job->end ; i++, ss++, ms++)
     {
 	ss->floorheight = SHORT(ms->floorheight)<<FRACBITS;
 	ss->ceilingheight = SHORT(ms->ceilingheight)<<FRACBITS;
-	ss->floorpic = R_FlatNumForName(ms->floorpic);
-	ss->ceilingpic = R_FlatNumForName(ms->ceilingpic);
+	ss->floorpic = FlatNumForName(job, ms->floorpic);
+	ss->ceilingpic = FlatNumForName(job, ms->ceilingpic);
 	ss->lightlevel = SHORT(ms->lightlevel);
 	ss->special = SHORT(ms->special);
 	ss->tag = SHORT(ms->tag);
 	ss->thinglist = NULL;
+
+	if (job->error[0] != '\0')
+	    return;
     }
-	
-    W_ReleaseLumpNum(lump);
 }
 
 
@@ -307,21 +432,24 @@ void P_LoadSectors (int lump)
 //
 void P_LoadNodes (int lump)
 {
-    byte*	data;
+    numnodes = W_LumpLength (lump) / sizeof(mapnode_t);
+    nodes = Z_Malloc (numnodes*sizeof(node_t),PU_LEVEL,0);	
+    CachePass (LP_NODES, lump, numnodes);
+}
+
+static void DecodeNodes (loadjob_t* job)
+{
     int		i;
     int		j;
     int		k;
+    unsigned	child;
     mapnode_t*	mn;
     node_t*	no;
 	
-    numnodes = W_LumpLength (lump) / sizeof(mapnode_t);
-    nodes = Z_Malloc (numnodes*sizeof(node_t),PU_LEVEL,0);	
-    data = W_CacheLumpNum (lump,PU_STATIC);
-	
-    mn = (mapnode_t *)data;
-    no = nodes;
+    mn = (mapnode_t *)passdata[LP_NODES] + job->start;
+    no = nodes + job->start;
     
-    for (i=0 ; i<numnodes ; i++, no++, mn++)
+    for (i=job->start ; i<job->end ; i++, no++, mn++)
     {
 	no->x = SHORT(mn->x)<<FRACBITS;
 	no->y = SHORT(mn->y)<<FRACBITS;
@@ -329,13 +457,368 @@ void P_LoadNodes (int lump)
 	no->dy = SHORT(mn->dy)<<FRACBITS;
 	for (j=0 ; j<2 ; j++)
 	{
-	    no->children[j] = SHORT(mn->children[j]);
+	    child = (unsigned short) SHORT(mn->children[j]);
+	    if (child & NF_SUBSECTOR_VANILLA)
+		child = (child & ~NF_SUBSECTOR_VANILLA) | NF_SUBSECTOR;
+	    no->children[j] = child;
+
 	    for (k=0 ; k<4 ; k++)
 		no->bbox[j][k] = SHORT(mn->bbox[j][k])<<FRACBITS;
 	}
     }
-	
-    W_ReleaseLumpNum(lump);
+}
+
+
+//
+// EXTENDED NODES
+// P_LoadExtendedNodes stands in for P_LoadSubsectors and
+//  P_LoadNodes when the NODES lump holds ZDBSP extended nodes.
+//  The new vertexes and the subsectors are read straight away;
+//  the nodes are decoded by the nodes pass and the segs, which
+//  need the linedefs, by the segs pass once P_LoadExtendedSegs
+//  has cached the lump again.
+// Compressed ZNOD nodes are inflated once, into a level buffer
+//  that both passes read in place of the lump.
+//
+static boolean	extendednodes;
+static int	extendedsegs;	// offset of the seg table
+static byte*	inflatednodes;	// NULL unless the nodes were ZNOD
+static int	inflatedlength;
+
+
+#ifdef HAVE_LIBZ
+//
+// InflateNodes
+// Inflates a ZNOD lump into inflatednodes.  The XNOD magic is
+//  put back in front, so that the data reads exactly like an
+//  uncompressed lump.
+//
+static void InflateNodes (int lump)
+{
+    z_stream	zs;
+    byte*	data;
+    byte*	out;
+    int		size;
+    int		err;
+
+    data = W_CacheLumpNum (lump, PU_STATIC);
+
+    memset (&zs, 0, sizeof(zs));
+    zs.next_in = data + 4;
+    zs.avail_in = W_LumpLength (lump) - 4;
+
+    if (inflateInit (&zs) != Z_OK)
+	I_Error ("P_SetupLevel: unable to inflate ZNOD nodes");
+
+    size = 4 + 4 * zs.avail_in + 1024;
+    out = I_Realloc (NULL, size);
+    memcpy (out, XNOD_MAGIC, 4);
+    zs.next_out = out + 4;
+    zs.avail_out = size - 4;
+
+    for (;;)
+    {
+	err = inflate (&zs, Z_NO_FLUSH);
+
+	if (err == Z_STREAM_END)
+	    break;
+
+	// Anything but a full output buffer means the stream is
+	//  damaged or stops short.
+	if ((err != Z_OK && err != Z_BUF_ERROR) || zs.avail_out != 0)
+	    I_Error ("P_SetupLevel: ZNOD nodes are corrupt or truncated");
+
+	size *= 2;
+	out = I_Realloc (out, size);
+	zs.next_out = out + 4 + zs.total_out;
+	zs.avail_out = size - 4 - zs.total_out;
+    }
+
+    inflatedlength = 4 + zs.total_out;
+    inflateEnd (&zs);
+    W_ReleaseLumpNum (lump);
+
+    // The zone clears inflatednodes when the level is freed.
+    inflatednodes = Z_Malloc (inflatedlength, PU_LEVEL, &inflatednodes);
+    memcpy (inflatednodes, out, inflatedlength);
+    free (out);
+}
+#endif
+
+
+//
+// CheckExtendedNodes
+// Returns true if the NODES lump holds extended nodes.
+//
+static boolean CheckExtendedNodes (int lump)
+{
+    byte*	data;
+    boolean	result;
+
+    if (W_LumpLength (lump) < 4)
+	return false;
+
+    data = W_CacheLumpNum (lump, PU_STATIC);
+
+    if (!memcmp (data, ZNOD_MAGIC, 4))
+    {
+#ifdef HAVE_LIBZ
+	W_ReleaseLumpNum (lump);
+	InflateNodes (lump);
+	return true;
+#else
+	I_Error ("P_SetupLevel: compressed ZNOD nodes need a build with "
+		 "zlib, rebuild the map with uncompressed XNOD nodes");
+#endif
+    }
+
+    result = !memcmp (data, XNOD_MAGIC, 4);
+    W_ReleaseLumpNum (lump);
+
+    return result;
+}
+
+
+//
+// ExtendedInt
+// Reads a 32-bit value from the NODES lump and steps past it.
+//
+static unsigned int ExtendedInt (byte* data, int length, int* offset)
+{
+    unsigned int	value;
+
+    if (length - *offset < 4)
+	I_Error ("P_LoadExtendedNodes: NODES lump is truncated");
+
+    memcpy (&value, data + *offset, 4);
+    *offset += 4;
+
+    return LONG(value);
+}
+
+
+//
+// ExtendedTable
+// Reads the count of a table in the NODES lump and checks that
+//  the whole table is there.
+//
+static int ExtendedTable (byte* data, int length, int* offset, int size)
+{
+    unsigned int	count;
+
+    count = ExtendedInt (data, length, offset);
+
+    if (count > (unsigned) (length - *offset) / size)
+	I_Error ("P_LoadExtendedNodes: NODES lump is truncated");
+
+    return count;
+}
+
+
+//
+// ExtendedData
+// Returns the extended nodes for a pass to decode, with the lump
+//  RunLoadPasses has to release afterwards, or -1 when they were
+//  inflated.
+//
+static byte* ExtendedData (int lump, int* length, int* passlumpnum)
+{
+    if (inflatednodes != NULL)
+    {
+	*length = inflatedlength;
+	*passlumpnum = -1;
+	return inflatednodes;
+    }
+
+    *length = W_LumpLength (lump);
+    *passlumpnum = lump;
+    return W_CacheLumpNum (lump, PU_STATIC);
+}
+
+
+//
+// P_LoadExtendedNodes
+//
+void P_LoadExtendedNodes (int lump)
+{
+    byte*		data;
+    int			length;
+    int			offset;
+    int			orgverts;
+    int			newverts;
+    int			firstseg;
+    unsigned int	count;
+    mapvertex_x_t*	mv;
+    vertex_t*		li;
+    subsector_t*	ss;
+    int			i;
+
+    data = ExtendedData (lump, &length, &passlump[LP_NODES]);
+    offset = 4;
+
+    // Vertexes past the ones kept from VERTEXES are replaced by
+    //  the node builder's own.  Nothing points into the vertex
+    //  array until the linedefs are decoded, so it can simply be
+    //  allocated again at the new size.
+    orgverts = ExtendedInt (data, length, &offset);
+
+    if ((unsigned) orgverts > (unsigned) numvertexes)
+    {
+	I_Error ("P_LoadExtendedNodes: %u vertexes kept, but there "
+		 "are only %i", (unsigned) orgverts, numvertexes);
+    }
+
+    newverts = ExtendedTable (data, length, &offset, sizeof(mapvertex_x_t));
+
+    Z_Free (vertexes);
+    numvertexes = orgverts + newverts;
+    vertexes = Z_Malloc (numvertexes*sizeof(vertex_t),PU_LEVEL,0);
+    passcount[LP_VERTEXES] = orgverts;
+
+    mv = (mapvertex_x_t *) (data + offset);
+    li = vertexes + orgverts;
+
+    for (i=0 ; i<newverts ; i++, li++, mv++)
+    {
+	li->x = LONG(mv->x);
+	li->y = LONG(mv->y);
+    }
+
+    offset += newverts * sizeof(mapvertex_x_t);
+
+    // Subsectors only store their seg counts; the segs are in
+    //  subsector order.
+    numsubsectors = ExtendedTable (data, length, &offset, 4);
+    subsectors = Z_Malloc (numsubsectors*sizeof(subsector_t),PU_LEVEL,0);
+    memset (subsectors, 0, numsubsectors*sizeof(subsector_t));
+
+    firstseg = 0;
+
+    for (i=0, ss=subsectors ; i<numsubsectors ; i++, ss++)
+    {
+	count = ExtendedInt (data, length, &offset);
+
+	if (count > length / sizeof(mapseg_x_t) - firstseg)
+	    I_Error ("P_LoadExtendedNodes: NODES lump is truncated");
+
+	ss->numlines = count;
+	ss->firstline = firstseg;
+	firstseg += count;
+    }
+
+    passcount[LP_SUBSECTORS] = 0;
+
+    numsegs = ExtendedTable (data, length, &offset, sizeof(mapseg_x_t));
+
+    if (numsegs != firstseg)
+    {
+	I_Error ("P_LoadExtendedNodes: subsectors use %i segs, but "
+		 "there are %i", firstseg, numsegs);
+    }
+
+    extendedsegs = offset;
+    offset += numsegs * sizeof(mapseg_x_t);
+
+    numnodes = ExtendedTable (data, length, &offset, sizeof(mapnode_x_t));
+    nodes = Z_Malloc (numnodes*sizeof(node_t),PU_LEVEL,0);
+
+    passdata[LP_NODES] = data + offset;
+    passcount[LP_NODES] = numnodes;
+}
+
+static void DecodeExtendedNodes (loadjob_t* job)
+{
+    int			i;
+    int			j;
+    int			k;
+    mapnode_x_t*	mn;
+    node_t*		no;
+
+    mn = (mapnode_x_t *)passdata[LP_NODES] + job->start;
+    no = nodes + job->start;
+
+    for (i=job->start ; i<job->end ; i++, no++, mn++)
+    {
+	no->x = SHORT(mn->x)<<FRACBITS;
+	no->y = SHORT(mn->y)<<FRACBITS;
+	no->dx = SHORT(mn->dx)<<FRACBITS;
+	no->dy = SHORT(mn->dy)<<FRACBITS;
+	for (j=0 ; j<2 ; j++)
+	{
+	    no->children[j] = LONG(mn->children[j]);
+	    for (k=0 ; k<4 ; k++)
+		no->bbox[j][k] = SHORT(mn->bbox[j][k])<<FRACBITS;
+	}
+    }
+}
+
+
+//
+// P_LoadExtendedSegs
+// Stands in for P_LoadSegs; the segs were counted by
+//  P_LoadExtendedNodes.
+//
+void P_LoadExtendedSegs (int lump)
+{
+    int		length;
+
+    segs = Z_Malloc (numsegs*sizeof(seg_t),PU_LEVEL,0);
+
+    GetSectorAtNullAddress ();
+
+    passdata[LP_SEGS] = ExtendedData (lump, &length, &passlump[LP_SEGS])
+		      + extendedsegs;
+    passcount[LP_SEGS] = numsegs;
+}
+
+static void DecodeExtendedSegs (loadjob_t* job)
+{
+    int			i;
+    mapseg_x_t*		ml;
+    seg_t*		li;
+    unsigned int	v1;
+    unsigned int	v2;
+    int			linedef;
+    vertex_t*		start;
+    double		dx;
+    double		dy;
+
+    ml = (mapseg_x_t *)passdata[LP_SEGS] + job->start;
+    li = segs + job->start;
+    memset (li, 0, (job->end - job->start)*sizeof(seg_t));
+
+    for (i=job->start ; i<job->end ; i++, li++, ml++)
+    {
+	v1 = LONG(ml->v1);
+	v2 = LONG(ml->v2);
+	linedef = (unsigned short) SHORT(ml->linedef);
+
+	if (v1 >= (unsigned) numvertexes || v2 >= (unsigned) numvertexes
+	 || linedef >= numlines || ml->side > 1)
+	{
+	    M_snprintf (job->error, sizeof(job->error),
+			"P_LoadExtendedSegs: seg %d is out of range", i);
+	    return;
+	}
+
+	li->v1 = &vertexes[v1];
+	li->v2 = &vertexes[v2];
+
+	if (!SetSegSides (job, li, i, linedef, ml->side))
+	    return;
+
+	// The angle and offset are not stored and are worked out
+	//  here.  R_PointToAngle2 moves the view, so it cannot be
+	//  used off the main thread.
+	dx = (double) li->v2->x - li->v1->x;
+	dy = (double) li->v2->y - li->v1->y;
+	li->angle = (angle_t) (long long) (atan2 (dy, dx) * ANG180 / M_PI);
+
+	start = ml->side ? li->linedef->v2 : li->linedef->v1;
+	dx = (double) li->v1->x - start->x;
+	dy = (double) li->v1->y - start->y;
+	li->offset = (fixed_t) sqrt (dx*dx + dy*dy);
+    }
 }
 
 
@@ -388,27 +871,30 @@ void P_LoadThings (int lump)
 //
 void P_LoadLineDefs (int lump)
 {
-    byte*		data;
+    numlines = W_LumpLength (lump) / sizeof(maplinedef_t);
+    lines = Z_Malloc (numlines*sizeof(line_t),PU_LEVEL,0);	
+    CachePass (LP_LINEDEFS, lump, numlines);
+}
+
+static void DecodeLineDefs (loadjob_t* job)
+{
     int			i;
     maplinedef_t*	mld;
     line_t*		ld;
     vertex_t*		v1;
     vertex_t*		v2;
 	
-    numlines = W_LumpLength (lump) / sizeof(maplinedef_t);
-    lines = Z_Malloc (numlines*sizeof(line_t),PU_LEVEL,0);	
-    memset (lines, 0, numlines*sizeof(line_t));
-    data = W_CacheLumpNum (lump,PU_STATIC);
-	
-    mld = (maplinedef_t *)data;
-    ld = lines;
-    for (i=0 ; i<numlines ; i++, mld++, ld++)
+    mld = (maplinedef_t *)passdata[LP_LINEDEFS] + job->start;
+    ld = lines + job->start;
+    memset (ld, 0, (job->end - job->start)*sizeof(line_t));
+
+    for (i=job->start ; i<job->end ; i++, mld++, ld++)
     {
 	ld->flags = SHORT(mld->flags);
 	ld->special = SHORT(mld->special);
 	ld->tag = SHORT(mld->tag);
-	v1 = ld->v1 = &vertexes[SHORT(mld->v1)];
-	v2 = ld->v2 = &vertexes[SHORT(mld->v2)];
+	v1 = ld->v1 = &vertexes[(unsigned short) SHORT(mld->v1)];
+	v2 = ld->v2 = &vertexes[(unsigned short) SHORT(mld->v2)];
 	ld->dx = v2->x - v1->x;
 	ld->dy = v2->y - v1->y;
 	
@@ -435,103 +921,618 @@ void P_LoadLineDefs (int lump)
 	    ld->bbox[BOXRIGHT] = v1->x;
 	}
 
-	if (v1->y < v2->y)
-	{
-	    ld->bbox[BOXBOTTOM] = v1->y;
-	    ld->bbox[BOXTOP] = v2->y;
-	}
-	else
+	if (v1->y < v2->y)
+	{
+	    ld->bbox[BOXBOTTOM] = v1->y;
+	    ld->bbox[BOXTOP] = v2->y;
+	}
+	else
+	{
+	    ld->bbox[BOXBOTTOM] = v2->y;
+	    ld->bbox[BOXTOP] = v1->y;
+	}
+
+	ld->sidenum[0] = SHORT(mld->sidenum[0]);
+	ld->sidenum[1] = SHORT(mld->sidenum[1]);
+
+	if (ld->sidenum[0] != -1)
+	    ld->frontsector = sides[ld->sidenum[0]].sector;
+	else
+	    ld->frontsector = 0;
+
+	if (ld->sidenum[1] != -1)
+	    ld->backsector = sides[ld->sidenum[1]].sector;
+	else
+	    ld->backsector = 0;
+    }
+}
+
+
+//
+// P_LoadSideDefs
+//
+void P_LoadSideDefs (int lump)
+{
+    numsides = W_LumpLength (lump) / sizeof(mapsidedef_t);
+    sides = Z_Malloc (numsides*sizeof(side_t),PU_LEVEL,0);	
+    CachePass (LP_SIDEDEFS, lump, numsides);
+}
+
+//
+// TextureNumForName
+// R_TextureNumForName, with the error kept in the job.
+//
+static int TextureNumForName (loadjob_t* job, const char* name)
+{
+    int		i;
+	
+    i = R_CheckTextureNumForName (name);
+
+    if (i == -1 && job->error[0] == '\0')
+    {
+	M_snprintf (job->error, sizeof(job->error),
+		    "R_TextureNumForName: %.8s not found", name);
+    }
+    return i;
+}
+
+static void DecodeSideDefs (loadjob_t* job)
+{
+    int			i;
+    mapsidedef_t*	msd;
+    side_t*		sd;
+	
+    msd = (mapsidedef_t *)passdata[LP_SIDEDEFS] + job->start;
+    sd = sides + job->start;
+    memset (sd, 0, (job->end - job->start)*sizeof(side_t));
+
+    for (i=job->start ; i<job->end ; i++, msd++, sd++)
+    {
+	sd->textureoffset = SHORT(msd->textureoffset)<<FRACBITS;
+	sd->rowoffset = SHORT(msd->rowoffset)<<FRACBITS;
+	sd->toptexture = TextureNumForName(job, msd->toptexture);
+	sd->bottomtexture = TextureNumForName(job, msd->bottomtexture);
+	sd->midtexture = TextureNumForName(job, msd->midtexture);
+	sd->sector = &sectors[SHORT(msd->sector)];
+
+	if (job->error[0] != '\0')
+	    return;
+    }
+}
+
+
+//
+// ClearBlockLinks
+// Allocates the empty mobj chains once the blockmap size is known.
+//
+static void ClearBlockLinks (void)
+{
+    int count;
+
+    count = sizeof(*blocklinks) * bmapwidth * bmapheight;
+    blocklinks = Z_Malloc(count, PU_LEVEL, 0);
+    memset(blocklinks, 0, count);
+
+    count = sizeof(*blockcells) * bmapwidth * bmapheight;
+    blockcells = Z_Malloc(count, PU_LEVEL, 0);
+    memset(blockcells, 0, count);
+}
+
+//
+// P_LoadBlockMap
+// Returns false, loading nothing, if the blockmap has to be built
+//  by P_CreateBlockMap instead: when asked to with -blockmap, when
+//  the lump is missing or damaged, when it is too big for its 16 bit
+//  offsets, or when the block size is not the lump's 128 units.
+//
+boolean P_LoadBlockMap (int lump)
+{
+    int count;
+    int lumplen;
+    short* data;
+
+    blockmaplump = NULL;
+    blockmap = NULL;
+    passdata[LP_BLOCKMAP] = NULL;
+    passcount[LP_BLOCKMAP] = 0;
+
+    //!
+    // @category mod
+    //
+    // Build the blockmap of each level from its linedefs rather than
+    // loading the BLOCKMAP lump.
+    //
+
+    if (M_ParmExists("-blockmap") || MAPBLOCKUNITS != 128)
+	return false;
+
+    lumplen = W_LumpLength(lump);
+    count = lumplen / 2;
+	
+    if (count < 4 || count > 0x10000)
+	return false;
+
+    // Read the header
+
+    data = W_CacheLumpNum(lump, PU_STATIC);
+
+    bmaporgx = SHORT(data[0])<<FRACBITS;
+    bmaporgy = SHORT(data[1])<<FRACBITS;
+    bmapwidth = SHORT(data[2]);
+    bmapheight = SHORT(data[3]);
+
+    if (bmapwidth <= 0 || bmapheight <= 0
+     || 4 + bmapwidth * bmapheight > count)
+    {
+	W_ReleaseLumpNum(lump);
+	return false;
+    }
+
+    // Widened to ints by DecodeBlockMap.
+    blockmaplump = Z_Malloc(count * sizeof(*blockmaplump), PU_LEVEL, NULL);
+    blockmap = blockmaplump + 4;
+    blockmapsize = count;
+
+    passdata[LP_BLOCKMAP] = (byte *) data;
+    passlump[LP_BLOCKMAP] = lump;
+    passcount[LP_BLOCKMAP] = count;
+
+    // Clear out mobj chains
+
+    ClearBlockLinks ();
+
+    return true;
+}
+
+static void DecodeBlockMap (loadjob_t* job)
+{
+    short* data;
+    int i;
+    int n;
+
+    data = (short *) passdata[LP_BLOCKMAP];
+
+    // Swap all short integers to native byte ordering.  Past the
+    //  header, offsets and line numbers are unsigned, so maps with
+    //  more than 32767 of either still load; -1 ends each list.
+  
+    for (i=job->start; i<job->end; i++)
+    {
+	n = SHORT(data[i]);
+
+	if (i >= 4 && n != -1)
+	    n &= 0xffff;
+
+	blockmaplump[i] = n;
+    }
+}
+
+
+//
+// P_CreateBlockMap
+// Builds the blockmap from the linedefs.  Each line goes in every
+//  block its segment touches, so blocks on either side of a shared
+//  boundary both get it; an extra line costs a bounding box test,
+//  a missing one a collision bug.  Lists are in line order and led
+//  by line 0, like those of the node builders, and blocks with the
+//  same list share it.
+//
+typedef struct
+{
+    int*	counts;		// lines per block
+    int*	fill;		// next free slot per block, or NULL
+    int*	lines;
+
+} blockbuild_t;
+
+static void AddLineToBlocks (blockbuild_t* build, int linenum)
+{
+    line_t*	ld;
+    int64_t	x1, y1, x2, y2;
+    int64_t	cx1, cx2;
+    int64_t	ya, yb, ylo, yhi;
+    int64_t	dx, dy;
+    int		bx, bx1, bx2;
+    int		by, by1, by2;
+    int		block;
+
+    ld = &lines[linenum];
+
+    x1 = (ld->v1->x - bmaporgx) >> FRACBITS;
+    y1 = (ld->v1->y - bmaporgy) >> FRACBITS;
+    x2 = (ld->v2->x - bmaporgx) >> FRACBITS;
+    y2 = (ld->v2->y - bmaporgy) >> FRACBITS;
+
+    if (x1 > x2)
+    {
+	cx1 = x1; x1 = x2; x2 = cx1;
+	cx1 = y1; y1 = y2; y2 = cx1;
+    }
+
+    dx = x2 - x1;
+    dy = y2 - y1;
+    bx1 = x1 >> MAPBLOCKBITS;
+    bx2 = x2 >> MAPBLOCKBITS;
+
+    for (bx=bx1 ; bx<=bx2 ; bx++)
+    {
+	// Where the segment enters and leaves this column.
+	cx1 = (int64_t) bx << MAPBLOCKBITS;
+	cx2 = cx1 + MAPBLOCKUNITS;
+	cx1 = cx1 > x1 ? cx1 : x1;
+	cx2 = cx2 < x2 ? cx2 : x2;
+
+	if (dx == 0)
+	{
+	    ylo = y1 < y2 ? y1 : y2;
+	    yhi = y1 < y2 ? y2 : y1;
+	}
+	else
+	{
+	    // Rounded outwards, so no block the segment grazes
+	    //  is left out.
+	    ya = y1 * dx + (cx1 - x1) * dy;
+	    yb = y1 * dx + (cx2 - x1) * dy;
+
+	    if (ya > yb)
+	    {
+		ylo = yb; yb = ya; ya = ylo;
+	    }
+
+	    ylo = ya / dx;
+	    yhi = (yb + dx - 1) / dx;
+	}
+
+	by1 = ylo >> MAPBLOCKBITS;
+	by2 = yhi >> MAPBLOCKBITS;
+
+	if (by2 >= bmapheight)
+	    by2 = bmapheight - 1;
+
+	for (by=by1 ; by<=by2 ; by++)
+	{
+	    block = by * bmapwidth + bx;
+
+	    if (build->fill)
+		build->lines[build->fill[block]++] = linenum;
+	    else
+		build->counts[block]++;
+	}
+    }
+}
+
+void P_CreateBlockMap (void)
+{
+    blockbuild_t	build;
+    int*		start;
+    int*		hashes;
+    int*		chain;
+    int*		out;
+    int			numblocks;
+    int			minx, miny, maxx, maxy;
+    int			total;
+    int			size;
+    int			i;
+    int			j;
+    int			k;
+    int			n;
+    unsigned int	hash;
+
+    minx = miny = INT_MAX;
+    maxx = maxy = INT_MIN;
+
+    for (i=0 ; i<numvertexes ; i++)
+    {
+	j = vertexes[i].x >> FRACBITS;
+	k = vertexes[i].y >> FRACBITS;
+	minx = j < minx ? j : minx;
+	maxx = j > maxx ? j : maxx;
+	miny = k < miny ? k : miny;
+	maxy = k > maxy ? k : maxy;
+    }
+
+    if (numvertexes == 0)
+	minx = miny = maxx = maxy = 0;
+
+    bmaporgx = minx << FRACBITS;
+    bmaporgy = miny << FRACBITS;
+    bmapwidth = ((maxx - minx) >> MAPBLOCKBITS) + 1;
+    bmapheight = ((maxy - miny) >> MAPBLOCKBITS) + 1;
+    numblocks = bmapwidth * bmapheight;
+
+    // Count the lines in each block, then lay the lists out back
+    //  to back and fill them.
+    build.counts = Z_Malloc(numblocks * sizeof(int), PU_STATIC, NULL);
+    memset(build.counts, 0, numblocks * sizeof(int));
+    build.fill = NULL;
+
+    for (i=0 ; i<numlines ; i++)
+	AddLineToBlocks (&build, i);
+
+    start = Z_Malloc((numblocks + 1) * sizeof(int), PU_STATIC, NULL);
+    total = 0;
+
+    for (i=0 ; i<numblocks ; i++)
+    {
+	start[i] = total;
+	total += build.counts[i];
+    }
+    start[numblocks] = total;
+
+    build.fill = build.counts;
+    memcpy(build.fill, start, numblocks * sizeof(int));
+    build.lines = Z_Malloc((total ? total : 1) * sizeof(int),
+			   PU_STATIC, NULL);
+
+    for (i=0 ; i<numlines ; i++)
+	AddLineToBlocks (&build, i);
+
+    // Write the lump form, sharing identical lists through a hash
+    //  on their contents.
+    size = 4 + numblocks + total + 2 * numblocks;
+    blockmaplump = Z_Malloc(size * sizeof(*blockmaplump), PU_LEVEL, NULL);
+    blockmap = blockmaplump + 4;
+
+    blockmaplump[0] = minx;
+    blockmaplump[1] = miny;
+    blockmaplump[2] = bmapwidth;
+    blockmaplump[3] = bmapheight;
+
+    hashes = Z_Malloc(numblocks * sizeof(int), PU_STATIC, NULL);
+    chain = Z_Malloc(numblocks * sizeof(int), PU_STATIC, NULL);
+
+    for (i=0 ; i<numblocks ; i++)
+	hashes[i] = -1;
+
+    out = blockmap + numblocks;
+
+    for (i=0 ; i<numblocks ; i++)
+    {
+	n = start[i + 1] - start[i];
+	hash = 2166136261u;
+
+	for (j=start[i] ; j<start[i + 1] ; j++)
+	    hash = (hash ^ build.lines[j]) * 16777619u;
+
+	hash %= numblocks;
+
+	for (k=hashes[hash] ; k!=-1 ; k=chain[k])
+	{
+	    if (start[k + 1] - start[k] == n
+	     && !memcmp(&build.lines[start[k]], &build.lines[start[i]],
+			n * sizeof(int)))
+	    {
+		break;
+	    }
+	}
+
+	if (k != -1)
+	{
+	    blockmap[i] = blockmap[k];
+	    continue;
+	}
+
+	chain[i] = hashes[hash];
+	hashes[hash] = i;
+
+	blockmap[i] = out - blockmaplump;
+	*out++ = 0;
+	memcpy(out, &build.lines[start[i]], n * sizeof(int));
+	out += n;
+	*out++ = -1;
+    }
+
+    blockmapsize = out - blockmaplump;
+
+    Z_Free(build.counts);
+    Z_Free(build.lines);
+    Z_Free(start);
+    Z_Free(hashes);
+    Z_Free(chain);
+
+    ClearBlockLinks ();
+}
+
+
+//
+// P_InitBlockLines
+// Fills in blocklines once the blockmap and the linedefs are
+//  both there.
+//
+static void P_InitBlockLines (void)
+{
+    blockline_t*	bl;
+    line_t*		ld;
+    int			i;
+    int			n;
+
+    // The lists normally follow the offsets, but nothing says
+    //  they have to.
+    blocklinebase = 4 + bmapwidth * bmapheight;
+
+    for (i=0 ; i<bmapwidth * bmapheight ; i++)
+    {
+	if (blockmap[i] < blocklinebase)
+	    blocklinebase = blockmap[i];
+    }
+
+    numblocklines = blockmapsize - blocklinebase;
+
+    // One more to end a list that runs off the end of the lump.
+    blocklines = Z_Malloc((numblocklines + 1) * sizeof(*blocklines),
+			  PU_LEVEL, NULL);
+
+    for (i=0, bl=blocklines ; i<=numblocklines ; i++, bl++)
+    {
+	n = i < numblocklines ? blockmaplump[blocklinebase + i] : -1;
+
+	// A line number past the end is taken as the end of the
+	//  list, rather than reading past lines[].
+	if (n < 0 || n >= numlines)
 	{
-	    ld->bbox[BOXBOTTOM] = v2->y;
-	    ld->bbox[BOXTOP] = v1->y;
+	    bl->line = -1;
+	    continue;
 	}
 
-	ld->sidenum[0] = SHORT(mld->sidenum[0]);
-	ld->sidenum[1] = SHORT(mld->sidenum[1]);
+	ld = &lines[n];
+	memcpy(bl->bbox, ld->bbox, sizeof(bl->bbox));
+	bl->x = ld->v1->x;
+	bl->y = ld->v1->y;
+	bl->dx = ld->dx;
+	bl->dy = ld->dy;
+	bl->slopetype = ld->slopetype;
+	bl->line = n;
+    }
+}
 
-	if (ld->sidenum[0] != -1)
-	    ld->frontsector = sides[ld->sidenum[0]].sector;
-	else
-	    ld->frontsector = 0;
 
-	if (ld->sidenum[1] != -1)
-	    ld->backsector = sides[ld->sidenum[1]].sector;
-	else
-	    ld->backsector = 0;
-    }
+static void (*decoders[NUMLOADPASSES]) (loadjob_t* job) =
+{
+    DecodeBlockMap,
+    DecodeVertexes,
+    DecodeSectors,
+    DecodeSideDefs,
+    DecodeSubsectors,
+    DecodeNodes,
+    DecodeLineDefs,
+    DecodeSegs,
+};
+
+static void (*extendeddecoders[NUMLOADPASSES]) (loadjob_t* job) =
+{
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    DecodeExtendedNodes,
+    NULL,
+    DecodeExtendedSegs,
+};
+
+static void LoadJob (void* data, int index)
+{
+    loadjob_t*	job = (loadjob_t *) data + index;
 
-    W_ReleaseLumpNum(lump);
+    if (extendednodes && extendeddecoders[job->pass] != NULL)
+	extendeddecoders[job->pass] (job);
+    else
+	decoders[job->pass] (job);
 }
 
-
 //
-// P_LoadSideDefs
+// RunLoadPasses
+// Decodes the records of passes first to last, then releases
+//  their lumps.
 //
-void P_LoadSideDefs (int lump)
+static void RunLoadPasses (loadpass_t first, loadpass_t last)
 {
-    byte*		data;
-    int			i;
-    mapsidedef_t*	msd;
-    side_t*		sd;
-	
-    numsides = W_LumpLength (lump) / sizeof(mapsidedef_t);
-    sides = Z_Malloc (numsides*sizeof(side_t),PU_LEVEL,0);	
-    memset (sides, 0, numsides*sizeof(side_t));
-    data = W_CacheLumpNum (lump,PU_STATIC);
-	
-    msd = (mapsidedef_t *)data;
-    sd = sides;
-    for (i=0 ; i<numsides ; i++, msd++, sd++)
+    loadjob_t*	jobs;
+    int		numjobs;
+    int		pass;
+    int		start;
+    int		i;
+
+    numjobs = 0;
+    for (pass=first ; pass<=last ; pass++)
+	numjobs += (passcount[pass] + LOADCHUNK - 1) / LOADCHUNK;
+
+    if (numjobs > 0)
     {
-	sd->textureoffset = SHORT(msd->textureoffset)<<FRACBITS;
-	sd->rowoffset = SHORT(msd->rowoffset)<<FRACBITS;
-	sd->toptexture = R_TextureNumForName(msd->toptexture);
-	sd->bottomtexture = R_TextureNumForName(msd->bottomtexture);
-	sd->midtexture = R_TextureNumForName(msd->midtexture);
-	sd->sector = &sectors[SHORT(msd->sector)];
+	jobs = Z_Malloc (numjobs * sizeof(*jobs), PU_STATIC, NULL);
+
+	i = 0;
+	for (pass=first ; pass<=last ; pass++)
+	{
+	    for (start=0 ; start<passcount[pass] ; start+=LOADCHUNK)
+	    {
+		jobs[i].pass = pass;
+		jobs[i].start = start;
+		jobs[i].end = start + LOADCHUNK < passcount[pass] ?
+			      start + LOADCHUNK : passcount[pass];
+		jobs[i].error[0] = '\0';
+		i++;
+	    }
+	}
+
+	I_RunJobs (LoadJob, jobs, numjobs);
+
+	// Jobs are in load order, so the first error is the one
+	//  a serial load would have stopped at.
+	for (i=0 ; i<numjobs ; i++)
+	{
+	    if (jobs[i].error[0] != '\0')
+		I_Error ("%s", jobs[i].error);
+	}
+
+	Z_Free (jobs);
     }
 
-    W_ReleaseLumpNum(lump);
+    for (pass=first ; pass<=last ; pass++)
+    {
+	if (passdata[pass] != NULL)
+	{
+	    if (passlump[pass] >= 0)
+		W_ReleaseLumpNum (passlump[pass]);
+	    passdata[pass] = NULL;
+	}
+    }
 }
 
 
+
 //
-// P_LoadBlockMap
+// SectorBoxJob
+// Finds the sound origin and block bounding box of a range
+//  of sectors, once their line lists are built.
 //
-void P_LoadBlockMap (int lump)
+static void SectorBoxJob (void* data, int index)
 {
-    int i;
-    int count;
-    int lumplen;
+    int			i;
+    int			j;
+    int			end;
+    line_t*		li;
+    sector_t*		sector;
+    fixed_t		bbox[4];
+    int			block;
 
-    lumplen = W_LumpLength(lump);
-    count = lumplen / 2;
-	
-    blockmaplump = Z_Malloc(lumplen, PU_LEVEL, NULL);
-    W_ReadLump(lump, blockmaplump);
-    blockmap = blockmaplump + 4;
+    i = index * LOADCHUNK;
+    end = i + LOADCHUNK < numsectors ? i + LOADCHUNK : numsectors;
 
-    // Swap all short integers to native byte ordering.
-  
-    for (i=0; i<count; i++)
+    for (sector = &sectors[i] ; i<end ; i++, sector++)
     {
-	blockmaplump[i] = SHORT(blockmaplump[i]);
-    }
+	M_ClearBox (bbox);
+
+	for (j=0 ; j<sector->linecount; j++)
+	{
+            li = sector->lines[j];
+
+            M_AddToBox (bbox, li->v1->x, li->v1->y);
+            M_AddToBox (bbox, li->v2->x, li->v2->y);
+	}
+
+	// set the degenmobj_t to the middle of the bounding box
+	sector->soundorg.x = (bbox[BOXRIGHT]+bbox[BOXLEFT])/2;
+	sector->soundorg.y = (bbox[BOXTOP]+bbox[BOXBOTTOM])/2;
 		
-    // Read the header
+	// adjust bounding box to map blocks
+	block = (bbox[BOXTOP]-bmaporgy+MAXRADIUS)>>MAPBLOCKSHIFT;
+	block = block >= bmapheight ? bmapheight-1 : block;
+	sector->blockbox[BOXTOP]=block;
 
-    bmaporgx = blockmaplump[0]<<FRACBITS;
-    bmaporgy = blockmaplump[1]<<FRACBITS;
-    bmapwidth = blockmaplump[2];
-    bmapheight = blockmaplump[3];
-	
-    // Clear out mobj chains
+	block = (bbox[BOXBOTTOM]-bmaporgy-MAXRADIUS)>>MAPBLOCKSHIFT;
+	block = block < 0 ? 0 : block;
+	sector->blockbox[BOXBOTTOM]=block;
 
-    count = sizeof(*blocklinks) * bmapwidth * bmapheight;
-    blocklinks = Z_Malloc(count, PU_LEVEL, 0);
-    memset(blocklinks, 0, count);
-}
+	block = (bbox[BOXRIGHT]-bmaporgx+MAXRADIUS)>>MAPBLOCKSHIFT;
+	block = block >= bmapwidth ? bmapwidth-1 : block;
+	sector->blockbox[BOXRIGHT]=block;
 
+	block = (bbox[BOXLEFT]-bmaporgx-MAXRADIUS)>>MAPBLOCKSHIFT;
+	block = block < 0 ? 0 : block;
+	sector->blockbox[BOXLEFT]=block;
+    }
+}
 
 
 //
@@ -542,14 +1543,14 @@ void P_LoadBlockMap (int lump)
 void P_GroupLines (void)
 {
     line_t**		linebuffer;
+    sectoradj_t*	adjbuffer;
+    int			count;
     int			i;
     int			j;
     line_t*		li;
     sector_t*		sector;
     subsector_t*	ss;
     seg_t*		seg;
-    fixed_t		bbox[4];
-    int			block;
 	
     // look up sector number for each subsector
     ss = subsectors;
@@ -613,43 +1614,62 @@ void P_GroupLines (void)
         }
     }
     
-    // Generate bounding boxes for sectors
-	
-    sector = sectors;
-    for (i=0 ; i<numsectors ; i++, sector++)
+    // Pick out the two-sided lines and their far sectors.
+    count = 0;
+    for (i=0 ; i<numsectors ; i++)
     {
-	M_ClearBox (bbox);
+	sector = &sectors[i];
+	sector->adjcount = 0;
 
-	for (j=0 ; j<sector->linecount; j++)
+	for (j=0 ; j<sector->linecount ; j++)
 	{
-            li = sector->lines[j];
+	    li = sector->lines[j];
 
-            M_AddToBox (bbox, li->v1->x, li->v1->y);
-            M_AddToBox (bbox, li->v2->x, li->v2->y);
+	    if ((li->flags & ML_TWOSIDED) && li->backsector)
+		sector->adjcount++;
 	}
 
-	// set the degenmobj_t to the middle of the bounding box
-	sector->soundorg.x = (bbox[BOXRIGHT]+bbox[BOXLEFT])/2;
-	sector->soundorg.y = (bbox[BOXTOP]+bbox[BOXBOTTOM])/2;
-		
-	// adjust bounding box to map blocks
-	block = (bbox[BOXTOP]-bmaporgy+MAXRADIUS)>>MAPBLOCKSHIFT;
-	block = block >= bmapheight ? bmapheight-1 : block;
-	sector->blockbox[BOXTOP]=block;
+	count += sector->adjcount;
+    }
 
-	block = (bbox[BOXBOTTOM]-bmaporgy-MAXRADIUS)>>MAPBLOCKSHIFT;
-	block = block < 0 ? 0 : block;
-	sector->blockbox[BOXBOTTOM]=block;
+    adjbuffer = Z_Malloc ((count ? count : 1) * sizeof(sectoradj_t),
+			  PU_LEVEL, 0);
 
-	block = (bbox[BOXRIGHT]-bmaporgx+MAXRADIUS)>>MAPBLOCKSHIFT;
-	block = block >= bmapwidth ? bmapwidth-1 : block;
-	sector->blockbox[BOXRIGHT]=block;
+    for (i=0 ; i<numsectors ; i++)
+    {
+	sector = &sectors[i];
+	sector->adj = adjbuffer;
 
-	block = (bbox[BOXLEFT]-bmaporgx-MAXRADIUS)>>MAPBLOCKSHIFT;
-	block = block < 0 ? 0 : block;
-	sector->blockbox[BOXLEFT]=block;
+	for (j=0 ; j<sector->linecount ; j++)
+	{
+	    li = sector->lines[j];
+
+	    if (!(li->flags & ML_TWOSIDED) || !li->backsector)
+		continue;
+
+	    adjbuffer->line = li;
+	    adjbuffer->sector = li->frontsector == sector ? li->backsector
+							  : li->frontsector;
+	    adjbuffer->openstamp = -1;
+	    adjbuffer++;
+	}
+    }
+
+    // Generate bounding boxes for sectors
+    I_RunJobs (SectorBoxJob, NULL, (numsectors + LOADCHUNK - 1) / LOADCHUNK);
+
+    // Chain sectors by tag, hashed on the tag modulo
+    //  the count.  Built back to front so each chain runs in
+    //  ascending order, as the linear searches did.
+    for (i=0 ; i<numsectors ; i++)
+	sectors[i].firsttag = -1;
+
+    for (i=numsectors-1 ; i>=0 ; i--)
+    {
+	j = (unsigned short) sectors[i].tag % (unsigned) numsectors;
+	sectors[i].nexttag = sectors[j].firsttag;
+	sectors[j].firsttag = i;
     }
-	
 }
 
 // Pad the REJECT lump with extra data when the lump is too small,
@@ -708,6 +1728,212 @@ static void PadRejectArray(byte *array, unsigned int len)
     }
 }
 
+//
+// Generated REJECT.
+//
+// Many maps ship a REJECT lump of nothing but zeroes, so every
+// P_CheckSight call walks the BSP.  Such lumps are replaced with
+// one built from the same portal flow as the PVS, which only
+// rejects a pair of sectors when no straight line can get from one
+// to the other through two-sided lines.  P_CheckSight works on
+// coordinates truncated to whole map units, so the flow is given
+// a few units of slack to keep it from rejecting a sight line that
+// grazes a wall corner.  The result is kept in a cache file in the
+// config directory, keyed by the map geometry.
+//
+// The sight code has its own quirks that a sight line can slip
+// through, so the lump is left alone for demos and netgames.
+//
+
+#define REJECT_EPSILON		4.0
+#define REJECT_MAGIC		"LHRJ"
+#define REJECT_VERSION		1
+
+typedef struct
+{
+    char		magic[4];
+    int			version;
+    int			numsectors;
+} rejectheader_t;
+
+//
+// RejectCacheFile
+// Returns the name of the cache file for the map at maplump.
+//
+static char* RejectCacheFile (int maplump)
+{
+    static const int	geometry[] = { ML_VERTEXES, ML_LINEDEFS, ML_SIDEDEFS };
+    sha1_context_t	context;
+    sha1_digest_t	digest;
+    char		name[64];
+    byte*		data;
+    int			lump;
+    int			i;
+
+    SHA1_Init(&context);
+    SHA1_UpdateInt32(&context, numsectors);
+
+    for (i=0 ; i<(int) arrlen(geometry) ; i++)
+    {
+        lump = maplump + geometry[i];
+        data = W_CacheLumpNum(lump, PU_STATIC);
+        SHA1_UpdateInt32(&context, W_LumpLength(lump));
+        SHA1_Update(&context, data, W_LumpLength(lump));
+        W_ReleaseLumpNum(lump);
+    }
+
+    SHA1_Final(digest, &context);
+
+    M_StringCopy(name, "reject-", sizeof(name));
+    for (i=0 ; i<(int) sizeof(digest) ; i++)
+    {
+        M_snprintf(name + 7 + i * 2, sizeof(name) - 7 - i * 2,
+                   "%02x", digest[i]);
+    }
+    M_StringConcat(name, ".cache", sizeof(name));
+
+    return M_StringJoin(configdir, name, NULL);
+}
+
+//
+// ReadRejectCache
+//
+static boolean ReadRejectCache (char* filename, byte* matrix, int length)
+{
+    rejectheader_t*	header;
+    byte*		data;
+    int			filelength;
+    boolean		valid;
+
+    if (!M_FileExists(filename))
+        return false;
+
+    filelength = M_ReadFile(filename, &data);
+    header = (rejectheader_t *) data;
+
+    valid = filelength == (int) sizeof(rejectheader_t) + length
+         && !memcmp(header->magic, REJECT_MAGIC, sizeof(header->magic))
+         && header->version == REJECT_VERSION
+         && header->numsectors == numsectors;
+
+    if (valid)
+        memcpy(matrix, data + sizeof(rejectheader_t), length);
+
+    Z_Free(data);
+
+    return valid;
+}
+
+//
+// WriteRejectCache
+//
+static void WriteRejectCache (char* filename, byte* matrix, int length)
+{
+    rejectheader_t*	header;
+    byte*		data;
+
+    data = Z_Malloc(sizeof(rejectheader_t) + length, PU_STATIC, NULL);
+    header = (rejectheader_t *) data;
+    memcpy(header->magic, REJECT_MAGIC, sizeof(header->magic));
+    header->version = REJECT_VERSION;
+    header->numsectors = numsectors;
+    memcpy(data + sizeof(rejectheader_t), matrix, length);
+
+    if (!M_WriteFile(filename, data, sizeof(rejectheader_t) + length))
+        printf("P_BuildReject: unable to write %s\n", filename);
+
+    Z_Free(data);
+}
+
+//
+// P_BuildReject
+// Fills matrix with a REJECT table for the current level.
+// Returns false if the level cannot be flowed.
+//
+static boolean P_BuildReject (int maplump, byte* matrix, int length)
+{
+    char*	filename;
+    byte*	visible;
+    int		starttime;
+    int		overflows;
+    int		rejected;
+    int		pnum;
+    int		i;
+    int		j;
+
+    filename = RejectCacheFile(maplump);
+
+    if (ReadRejectCache(filename, matrix, length))
+    {
+        free(filename);
+        return true;
+    }
+
+    starttime = I_GetTimeMS();
+
+    visible = Z_Malloc(length, PU_STATIC, NULL);
+    overflows = R_SectorVisibility(visible, REJECT_EPSILON);
+
+    if (overflows < 0)
+    {
+        Z_Free(visible);
+        free(filename);
+        return false;
+    }
+
+    // The flow is not quite symmetric near the slack, so a pair is
+    //  only rejected if neither sector can see the other.
+    memset(matrix, 0, length);
+    rejected = 0;
+
+    for (i=0 ; i<numsectors ; i++)
+    {
+        for (j=0 ; j<numsectors ; j++)
+        {
+            int tnum = j * numsectors + i;
+
+            pnum = i * numsectors + j;
+
+            if (!(visible[pnum >> 3] & (1 << (pnum & 7)))
+             && !(visible[tnum >> 3] & (1 << (tnum & 7))))
+            {
+                matrix[pnum >> 3] |= 1 << (pnum & 7);
+                rejected++;
+            }
+        }
+    }
+
+    Z_Free(visible);
+
+    printf("P_BuildReject: %i sectors, %i%% rejected, %i unbounded, "
+           "%i ms\n", numsectors,
+           numsectors ? (int) ((rejected * 100LL)
+                               / ((long long) numsectors * numsectors))
+                      : 0,
+           overflows, I_GetTimeMS() - starttime);
+
+    WriteRejectCache(filename, matrix, length);
+    free(filename);
+
+    return true;
+}
+
+//
+// RejectIsEmpty
+//
+static boolean RejectIsEmpty (byte* matrix, int length)
+{
+    int		i;
+
+    for (i=0 ; i<length ; i++)
+    {
+        if (matrix[i])
+            return false;
+    }
+
+    return true;
+}
+
 static void P_LoadReject(int lumpnum)
 {
     int minlength;
@@ -726,6 +1952,27 @@ static void P_LoadReject(int lumpnum)
     if (lumplen >= minlength)
     {
         rejectmatrix = W_CacheLumpNum(lumpnum, PU_LEVEL);
+
+        //!
+        // @category compat
+        //
+        // Use empty REJECT lumps as they are, rather than building
+        // a REJECT table for the level.
+        //
+
+        if (!demoplayback && !demorecording && !netgame
+         && RejectIsEmpty(rejectmatrix, minlength)
+         && !M_CheckParm("-nobuildreject"))
+        {
+            W_ReleaseLumpNum(lumpnum);
+            rejectmatrix = Z_Malloc(minlength, PU_LEVEL, &rejectmatrix);
+
+            if (!P_BuildReject(lumpnum - ML_REJECT, rejectmatrix, minlength))
+            {
+                Z_Free(rejectmatrix);
+                rejectmatrix = W_CacheLumpNum(lumpnum, PU_LEVEL);
+            }
+        }
     }
     else
     {
@@ -752,6 +1999,7 @@ P_SetupLevel
     int		i;
     char	lumpname[9];
     int		lumpnum;
+    boolean	loadedblockmap;
 	
     totalkills = totalitems = totalsecret = wminfo.maxfrags = 0;
     wminfo.partime = 180;
@@ -769,6 +2017,7 @@ P_SetupLevel
     S_Start ();			
 
     Z_FreeTags (PU_LEVEL, PU_PURGELEVEL-1);
+    P_ClearThinkerPools ();
 
     // UNUSED W_Profile ();
     P_InitThinkers ();
@@ -789,19 +2038,42 @@ P_SetupLevel
     leveltime = 0;
 	
     // note: most of this ordering is important	
-    P_LoadBlockMap (lumpnum+ML_BLOCKMAP);
+    loadedblockmap = P_LoadBlockMap (lumpnum+ML_BLOCKMAP);
     P_LoadVertexes (lumpnum+ML_VERTEXES);
     P_LoadSectors (lumpnum+ML_SECTORS);
     P_LoadSideDefs (lumpnum+ML_SIDEDEFS);
 
+    extendednodes = CheckExtendedNodes (lumpnum+ML_NODES);
+
+    if (extendednodes)
+    {
+	P_LoadExtendedNodes (lumpnum+ML_NODES);
+    }
+    else
+    {
+	P_LoadSubsectors (lumpnum+ML_SSECTORS);
+	P_LoadNodes (lumpnum+ML_NODES);
+    }
+    RunLoadPasses (LP_BLOCKMAP, LP_NODES);
+
     P_LoadLineDefs (lumpnum+ML_LINEDEFS);
-    P_LoadSubsectors (lumpnum+ML_SSECTORS);
-    P_LoadNodes (lumpnum+ML_NODES);
-    P_LoadSegs (lumpnum+ML_SEGS);
+    RunLoadPasses (LP_LINEDEFS, LP_LINEDEFS);
+
+    if (!loadedblockmap)
+	P_CreateBlockMap ();
+    P_InitBlockLines ();
+
+    if (extendednodes)
+	P_LoadExtendedSegs (lumpnum+ML_NODES);
+    else
+	P_LoadSegs (lumpnum+ML_SEGS);
+    RunLoadPasses (LP_SEGS, LP_SEGS);
 
     P_GroupLines ();
     P_LoadReject (lumpnum+ML_REJECT);
 
+    R_BuildPVS ();
+
     bodyqueslot = 0;
     deathmatch_p = deathmatchstarts;
     P_LoadThings (lumpnum+ML_THINGS);
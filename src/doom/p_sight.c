@@ -17,6 +17,9 @@
 //
 
 
+#include <math.h>
+#include <stdio.h>
+
 #include "doomdef.h"
 #include "doomstat.h"
 
@@ -39,6 +42,45 @@ fixed_t t2y;
 
 int sightcounts[2];
 
+// Line of sight engines.  The BSP walk is what Vanilla Doom does and
+// the only one guaranteed to keep demos in sync.  The blockmap walk
+// finds the lines to test from the blockmap cells under the sight
+// line instead, which touches far less data on maps with deep BSP
+// trees.  SIGHT_VERIFY runs both, reports any disagreement and goes
+// by the BSP answer.  Pick one with the sight_engine build option,
+// e.g. meson configure build -Dsight_engine=verify.
+
+#define SIGHT_BSP 0
+#define SIGHT_BLOCKMAP 1
+#define SIGHT_VERIFY 2
+
+#ifndef SIGHT_ENGINE
+#define SIGHT_ENGINE SIGHT_BSP
+#endif
+
+// Results of recent full sight checks.  An entry is only valid for
+// the sightstamp it was made under, so the cache empties itself each
+// tic and whenever a plane moves.  The key is everything the BSP walk
+// reads from the two things, taken exactly; rounding the positions
+// would let a cached answer differ from the real one and break demo
+// sync.
+
+#define SIGHTCACHESIZE 1024
+
+typedef struct
+{
+    int stamp;
+    subsector_t *ss1;
+    subsector_t *ss2;
+    fixed_t x1, y1, z1, h1;
+    fixed_t x2, y2, z2, h2;
+    boolean result;
+} sightcache_t;
+
+static sightcache_t sightcache[SIGHTCACHESIZE];
+
+int sightstamp = 1;
+
 
 // PTR_SightTraverse() for Doom 1.2 sight calculations
 // taken from prboom-plus/src/p_sight.c:69-102
@@ -152,18 +194,14 @@ fixed_t P_InterceptVector2(divline_t *v2, divline_t *v1)
 }
 
 //
-// P_CrossSubsector
-// Returns true
-//  if strace crosses the given subsector successfully.
+// PIT_CrossSightLine
+// Returns false if line blocks strace.  Narrows topslope and
+//  bottomslope when it only partly blocks it.
 //
-boolean P_CrossSubsector(int num)
+static boolean PIT_CrossSightLine(line_t *line)
 {
-    seg_t *seg;
-    line_t *line;
     int s1;
     int s2;
-    int count;
-    subsector_t *sub;
     sector_t *front;
     sector_t *back;
     fixed_t opentop;
@@ -174,6 +212,99 @@ boolean P_CrossSubsector(int num)
     fixed_t frac;
     fixed_t slope;
 
+    v1 = line->v1;
+    v2 = line->v2;
+    s1 = P_DivlineSide(v1->x, v1->y, &strace);
+    s2 = P_DivlineSide(v2->x, v2->y, &strace);
+
+    // line isn't crossed?
+    if (s1 == s2)
+        return true;
+
+    divl.x = v1->x;
+    divl.y = v1->y;
+    divl.dx = v2->x - v1->x;
+    divl.dy = v2->y - v1->y;
+    s1 = P_DivlineSide(strace.x, strace.y, &divl);
+    s2 = P_DivlineSide(t2x, t2y, &divl);
+
+    // line isn't crossed?
+    if (s1 == s2)
+        return true;
+
+    // Backsector may be NULL if this is an "impassible
+    // glass" hack line.
+
+    if (line->backsector == NULL)
+    {
+        return false;
+    }
+
+    // stop because it is not two sided anyway
+    // might do this after updating validcount?
+    if (!(line->flags & ML_TWOSIDED))
+        return false;
+
+    // crosses a two sided line
+    front = line->frontsector;
+    back = line->backsector;
+
+    // no wall to block sight with?
+    if (front->floorheight == back->floorheight &&
+        front->ceilingheight == back->ceilingheight)
+        return true;
+
+    // possible occluder
+    // because of ceiling height differences
+    if (front->ceilingheight < back->ceilingheight)
+        opentop = front->ceilingheight;
+    else
+        opentop = back->ceilingheight;
+
+    // because of ceiling height differences
+    if (front->floorheight > back->floorheight)
+        openbottom = front->floorheight;
+    else
+        openbottom = back->floorheight;
+
+    // quick test for totally closed doors
+    if (openbottom >= opentop)
+        return false; // stop
+
+    frac = P_InterceptVector2(&strace, &divl);
+
+    if (front->floorheight != back->floorheight)
+    {
+        slope = FixedDiv(openbottom - sightzstart, frac);
+        if (slope > bottomslope)
+            bottomslope = slope;
+    }
+
+    if (front->ceilingheight != back->ceilingheight)
+    {
+        slope = FixedDiv(opentop - sightzstart, frac);
+        if (slope < topslope)
+            topslope = slope;
+    }
+
+    if (topslope <= bottomslope)
+        return false; // stop
+
+    return true;
+}
+
+//
+// P_CrossSubsector
+// Returns true
+//  if strace crosses the given subsector successfully.
+//
+boolean P_CrossSubsector(int num)
+{
+    seg_t *seg;
+    line_t *line;
+    int count;
+    subsector_t *sub;
+
 #ifdef RANGECHECK
     if (num >= numsubsectors)
         I_Error("P_CrossSubsector: ss %i with numss = %i", num, numsubsectors);
@@ -195,83 +326,8 @@ boolean P_CrossSubsector(int num)
 
         line->validcount = validcount;
 
-        v1 = line->v1;
-        v2 = line->v2;
-        s1 = P_DivlineSide(v1->x, v1->y, &strace);
-        s2 = P_DivlineSide(v2->x, v2->y, &strace);
-
-        // line isn't crossed?
-        if (s1 == s2)
-            continue;
-
-        divl.x = v1->x;
-        divl.y = v1->y;
-        divl.dx = v2->x - v1->x;
-        divl.dy = v2->y - v1->y;
-        s1 = P_DivlineSide(strace.x, strace.y, &divl);
-        s2 = P_DivlineSide(t2x, t2y, &divl);
-
-        // line isn't crossed?
-        if (s1 == s2)
-            continue;
-
-        // Backsector may be NULL if this is an "impassible
-        // glass" hack line.
-
-        if (line->backsector == NULL)
-        {
+        if (!PIT_CrossSightLine(line))
             return false;
-        }
-
-        // stop because it is not two sided anyway
-        // might do this after updating validcount?
-        if (!(line->flags & ML_TWOSIDED))
-            return false;
-
-        // crosses a two sided line
-        front = seg->frontsector;
-        back = seg->backsector;
-
-        // no wall to block sight with?
-        if (front->floorheight == back->floorheight &&
-            front->ceilingheight == back->ceilingheight)
-            continue;
-
-        // possible occluder
-        // because of ceiling height differences
-        if (front->ceilingheight < back->ceilingheight)
-            opentop = front->ceilingheight;
-        else
-            opentop = back->ceilingheight;
-
-        // because of ceiling height differences
-        if (front->floorheight > back->floorheight)
-            openbottom = front->floorheight;
-        else
-            openbottom = back->floorheight;
-
-        // quick test for totally closed doors
-        if (openbottom >= opentop)
-            return false; // stop
-
-        frac = P_InterceptVector2(&strace, &divl);
-
-        if (front->floorheight != back->floorheight)
-        {
-            slope = FixedDiv(openbottom - sightzstart, frac);
-            if (slope > bottomslope)
-                bottomslope = slope;
-        }
-
-        if (front->ceilingheight != back->ceilingheight)
-        {
-            slope = FixedDiv(opentop - sightzstart, frac);
-            if (slope < topslope)
-                topslope = slope;
-        }
-
-        if (topslope <= bottomslope)
-            return false; // stop
     }
     // passed the subsector ok
     return true;
@@ -319,6 +375,90 @@ boolean P_CrossBSPNode(int bspnum)
 }
 
 
+#if SIGHT_ENGINE != SIGHT_BSP
+
+//
+// P_CrossBlockmap
+// Returns true if strace crosses every line in the blockmap cells
+//  under it successfully.  The per-line test is the one the BSP walk
+//  uses; only the way the lines are found differs.  Each column of
+//  cells is widened by a unit either way, since testing a line too
+//  many is harmless and missing one is not.
+//
+static boolean P_CrossBlockmap(void)
+{
+    double x1, y1, x2, y2;
+    double colx1, colx2;
+    double ya, yb;
+    int bx, bx1, bx2;
+    int by, by1, by2;
+
+    x1 = (double) strace.x - bmaporgx;
+    y1 = (double) strace.y - bmaporgy;
+    x2 = (double) t2x - bmaporgx;
+    y2 = (double) t2y - bmaporgy;
+
+    if (x1 > x2)
+    {
+        colx1 = x1; x1 = x2; x2 = colx1;
+        ya = y1; y1 = y2; y2 = ya;
+    }
+
+    bx1 = (int) floor(x1 / MAPBLOCKSIZE);
+    bx2 = (int) floor(x2 / MAPBLOCKSIZE);
+
+    if (bx1 < 0)
+        bx1 = 0;
+    if (bx2 > bmapwidth - 1)
+        bx2 = bmapwidth - 1;
+
+    for (bx = bx1; bx <= bx2; bx++)
+    {
+        if (x1 == x2)
+        {
+            ya = y1;
+            yb = y2;
+        }
+        else
+        {
+            colx1 = (double) bx * MAPBLOCKSIZE;
+            colx2 = colx1 + MAPBLOCKSIZE;
+
+            if (colx1 < x1)
+                colx1 = x1;
+            if (colx2 > x2)
+                colx2 = x2;
+
+            ya = y1 + (colx1 - x1) * (y2 - y1) / (x2 - x1);
+            yb = y1 + (colx2 - x1) * (y2 - y1) / (x2 - x1);
+        }
+
+        if (ya > yb)
+        {
+            colx1 = ya; ya = yb; yb = colx1;
+        }
+
+        by1 = (int) floor((ya - FRACUNIT) / MAPBLOCKSIZE);
+        by2 = (int) floor((yb + FRACUNIT) / MAPBLOCKSIZE);
+
+        if (by1 < 0)
+            by1 = 0;
+        if (by2 > bmapheight - 1)
+            by2 = bmapheight - 1;
+
+        for (by = by1; by <= by2; by++)
+        {
+            if (!P_BlockLinesIterator(bx, by, PIT_CrossSightLine))
+                return false;
+        }
+    }
+
+    return true;
+}
+
+#endif
+
+
 //
 // P_CheckSight
 // Returns true
@@ -332,6 +472,9 @@ boolean P_CheckSight(mobj_t *t1, mobj_t *t2)
     int pnum;
     int bytenum;
     int bitnum;
+    unsigned int hash;
+    sightcache_t *entry;
+    boolean result;
 
     // First check for trivial rejection.
 
@@ -351,6 +494,24 @@ boolean P_CheckSight(mobj_t *t1, mobj_t *t2)
         return false;
     }
 
+    // Seen the same pair from the same spots already this tic?
+    hash = (unsigned int) (t1->subsector - subsectors) * 31
+         + (unsigned int) (t2->subsector - subsectors);
+    hash = hash * 31 + (unsigned int) (t1->x ^ t1->y ^ t1->z);
+    hash = hash * 31 + (unsigned int) (t2->x ^ t2->y ^ t2->z);
+    hash ^= hash >> 16;
+    entry = &sightcache[hash & (SIGHTCACHESIZE - 1)];
+
+    if (entry->stamp == sightstamp
+     && entry->ss1 == t1->subsector && entry->ss2 == t2->subsector
+     && entry->x1 == t1->x && entry->y1 == t1->y
+     && entry->z1 == t1->z && entry->h1 == t1->height
+     && entry->x2 == t2->x && entry->y2 == t2->y
+     && entry->z2 == t2->z && entry->h2 == t2->height)
+    {
+        return entry->result;
+    }
+
     // An unobstructed LOS is possible.
     // Now look from eyes of t1 to any part of t2.
     sightcounts[1]++;
@@ -368,6 +529,40 @@ boolean P_CheckSight(mobj_t *t1, mobj_t *t2)
     strace.dx = t2->x - t1->x;
     strace.dy = t2->y - t1->y;
 
+#if SIGHT_ENGINE == SIGHT_BLOCKMAP
+    result = P_CrossBlockmap();
+#else
     // the head node is the last node output
-    return P_CrossBSPNode(numnodes - 1);
+    result = P_CrossBSPNode(numnodes - 1);
+#endif
+
+#if SIGHT_ENGINE == SIGHT_VERIFY
+    topslope = (t2->z + t2->height) - sightzstart;
+    bottomslope = (t2->z) - sightzstart;
+    validcount++;
+
+    if (P_CrossBlockmap() != result)
+    {
+        printf("P_CheckSight: blockmap walk disagrees with BSP walk "
+               "(%s) from (%d, %d, %d) to (%d, %d, %d)\n",
+               result ? "visible" : "hidden",
+               t1->x >> FRACBITS, t1->y >> FRACBITS, t1->z >> FRACBITS,
+               t2->x >> FRACBITS, t2->y >> FRACBITS, t2->z >> FRACBITS);
+    }
+#endif
+
+    entry->stamp = sightstamp;
+    entry->ss1 = t1->subsector;
+    entry->ss2 = t2->subsector;
+    entry->x1 = t1->x;
+    entry->y1 = t1->y;
+    entry->z1 = t1->z;
+    entry->h1 = t1->height;
+    entry->x2 = t2->x;
+    entry->y2 = t2->y;
+    entry->z2 = t2->z;
+    entry->h2 = t2->height;
+    entry->result = result;
+
+    return result;
 }
@@ -243,17 +243,13 @@ sector_t *getNextSector(line_t *line, sector_t *sec)
 fixed_t P_FindLowestFloorSurrounding(sector_t *sec)
 {
     int i;
-    line_t *check;
+    sectoradj_t *adj;
     sector_t *other;
     fixed_t floor = sec->floorheight;
 
-    for (i = 0; i < sec->linecount; i++)
+    for (i = 0, adj = sec->adj; i < sec->adjcount; i++, adj++)
     {
-        check = sec->lines[i];
-        other = getNextSector(check, sec);
-
-        if (!other)
-            continue;
+        other = adj->sector;
 
         if (other->floorheight < floor)
             floor = other->floorheight;
@@ -269,17 +265,13 @@ fixed_t P_FindLowestFloorSurrounding(sector_t *sec)
 fixed_t P_FindHighestFloorSurrounding(sector_t *sec)
 {
     int i;
-    line_t *check;
+    sectoradj_t *adj;
     sector_t *other;
     fixed_t floor = -500 * FRACUNIT;
 
-    for (i = 0; i < sec->linecount; i++)
+    for (i = 0, adj = sec->adj; i < sec->adjcount; i++, adj++)
     {
-        check = sec->lines[i];
-        other = getNextSector(check, sec);
-
-        if (!other)
-            continue;
+        other = adj->sector;
 
         if (other->floorheight > floor)
             floor = other->floorheight;
@@ -291,46 +283,51 @@ fixed_t P_FindHighestFloorSurrounding(sector_t *sec)
 //
 // P_FindNextHighestFloor
 // FIND NEXT HIGHEST FLOOR IN SURROUNDING SECTORS
-// Note: this should be doable w/o a fixed array.
 
 // Thanks to entryway for the Vanilla overflow emulation.
 
-// 20 adjoining sectors max!
+// Vanilla Doom collected the candidates in a fixed array of
+// 20 adjoining sectors, overwriting its own search height at
+// 21 and crashing at 22.  That is only reproduced while demos
+// play or record; otherwise there is no limit.
 #define MAX_ADJOINING_SECTORS 20
 
 fixed_t P_FindNextHighestFloor(sector_t *sec, int currentheight)
 {
     int i;
     int h;
-    int min;
-    line_t *check;
+    sectoradj_t *adj;
     sector_t *other;
     fixed_t height = currentheight;
-    fixed_t heightlist[MAX_ADJOINING_SECTORS + 2];
+    fixed_t min = INT_MAX;
 
-    for (i = 0, h = 0; i < sec->linecount; i++)
+    for (i = 0, h = 0, adj = sec->adj; i < sec->adjcount; i++, adj++)
     {
-        check = sec->lines[i];
-        other = getNextSector(check, sec);
-
-        if (!other)
-            continue;
+        other = adj->sector;
 
         if (other->floorheight > height)
         {
-            // Emulation of memory (stack) overflow
-            if (h == MAX_ADJOINING_SECTORS + 1)
+            if (demoplayback || demorecording)
             {
-                height = other->floorheight;
+                // Emulation of memory (stack) overflow
+                if (h == MAX_ADJOINING_SECTORS + 1)
+                {
+                    height = other->floorheight;
+                }
+                else if (h == MAX_ADJOINING_SECTORS + 2)
+                {
+                    // Fatal overflow: game crashes at 22 sectors
+                    I_Error("Sector with more than 22 adjoining sectors. "
+                            "Vanilla will crash here");
+                }
             }
-            else if (h == MAX_ADJOINING_SECTORS + 2)
+
+            if (other->floorheight < min)
             {
-                // Fatal overflow: game crashes at 22 sectors
-                I_Error("Sector with more than 22 adjoining sectors. "
-                        "Vanilla will crash here");
+                min = other->floorheight;
             }
 
-            heightlist[h++] = other->floorheight;
+            h++;
         }
     }
 
@@ -340,17 +337,6 @@ fixed_t P_FindNextHighestFloor(sector_t *sec, int currentheight)
         return currentheight;
     }
 
-    min = heightlist[0];
-
-    // Range checking?
-    for (i = 1; i < h; i++)
-    {
-        if (heightlist[i] < min)
-        {
-            min = heightlist[i];
-        }
-    }
-
     return min;
 }
 
@@ -360,17 +346,13 @@ fixed_t P_FindNextHighestFloor(sector_t *sec, int currentheight)
 fixed_t P_FindLowestCeilingSurrounding(sector_t *sec)
 {
     int i;
-    line_t *check;
+    sectoradj_t *adj;
     sector_t *other;
     fixed_t height = INT_MAX;
 
-    for (i = 0; i < sec->linecount; i++)
+    for (i = 0, adj = sec->adj; i < sec->adjcount; i++, adj++)
     {
-        check = sec->lines[i];
-        other = getNextSector(check, sec);
-
-        if (!other)
-            continue;
+        other = adj->sector;
 
         if (other->ceilingheight < height)
             height = other->ceilingheight;
@@ -385,17 +367,13 @@ fixed_t P_FindLowestCeilingSurrounding(sector_t *sec)
 fixed_t P_FindHighestCeilingSurrounding(sector_t *sec)
 {
     int i;
-    line_t *check;
+    sectoradj_t *adj;
     sector_t *other;
     fixed_t height = 0;
 
-    for (i = 0; i < sec->linecount; i++)
+    for (i = 0, adj = sec->adj; i < sec->adjcount; i++, adj++)
     {
-        check = sec->lines[i];
-        other = getNextSector(check, sec);
-
-        if (!other)
-            continue;
+        other = adj->sector;
 
         if (other->ceilingheight > height)
             height = other->ceilingheight;
@@ -406,16 +384,38 @@ fixed_t P_FindHighestCeilingSurrounding(sector_t *sec)
 
 //
 // RETURN NEXT SECTOR # THAT LINE TAG REFERS TO
+// Walks the tag chains built in P_GroupLines; start must be -1
+//  or a sector returned by an earlier call for the same tag.
 //
 int P_FindSectorFromLineTag(line_t *line, int start)
 {
     int i;
 
-    for (i = start + 1; i < numsectors; i++)
-        if (sectors[i].tag == line->tag)
-            return i;
+    if (numsectors == 0)
+        return -1;
 
-    return -1;
+    if (start < 0)
+    {
+        i = sectors[(unsigned short) line->tag
+                    % (unsigned) numsectors].firsttag;
+    }
+    else if (sectors[start].tag == line->tag)
+    {
+        i = sectors[start].nexttag;
+    }
+    else
+    {
+        for (i = start + 1; i < numsectors; i++)
+            if (sectors[i].tag == line->tag)
+                return i;
+
+        return -1;
+    }
+
+    while (i >= 0 && sectors[i].tag != line->tag)
+        i = sectors[i].nexttag;
+
+    return i;
 }
 
 
@@ -426,17 +426,13 @@ int P_FindMinSurroundingLight(sector_t *sector, int max)
 {
     int i;
     int min;
-    line_t *line;
+    sectoradj_t *adj;
     sector_t *check;
 
     min = max;
-    for (i = 0; i < sector->linecount; i++)
+    for (i = 0, adj = sector->adj; i < sector->adjcount; i++, adj++)
     {
-        line = sector->lines[i];
-        check = getNextSector(line, sector);
-
-        if (!check)
-            continue;
+        check = adj->sector;
 
         if (check->lightlevel < min)
             min = check->lightlevel;
@@ -1273,8 +1269,8 @@ int EV_DoDonut(line_t *line)
             }
 
             //	Spawn rising slime
-            floor = Z_Malloc(sizeof(*floor), PU_LEVSPEC, 0);
-            P_AddThinker(&floor->thinker);
+            floor = P_AllocateThinker(sizeof(*floor), PU_LEVSPEC);
+            P_AddThinker(&floor->thinker, th_mover);
             s2->specialdata = floor;
             floor->thinker.function.acp1 = (actionf_p1) T_MoveFloor;
             floor->type = donutRaise;
@@ -1287,8 +1283,8 @@ int EV_DoDonut(line_t *line)
             floor->floordestheight = s3_floorheight;
 
             //	Spawn lowering donut-hole
-            floor = Z_Malloc(sizeof(*floor), PU_LEVSPEC, 0);
-            P_AddThinker(&floor->thinker);
+            floor = P_AllocateThinker(sizeof(*floor), PU_LEVSPEC);
+            P_AddThinker(&floor->thinker, th_mover);
             s1->specialdata = floor;
             floor->thinker.function.acp1 = (actionf_p1) T_MoveFloor;
             floor->type = lowerFloor;
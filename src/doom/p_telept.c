@@ -38,7 +38,6 @@
 int EV_Teleport(line_t *line, int side, mobj_t *thing)
 {
     int i;
-    int tag;
     mobj_t *m;
     mobj_t *fog;
     unsigned an;
@@ -58,59 +57,53 @@ int EV_Teleport(line_t *line, int side, mobj_t *thing)
         return 0;
 
 
-    tag = line->tag;
-    for (i = 0; i < numsectors; i++)
+    i = -1;
+    while ((i = P_FindSectorFromLineTag(line, i)) >= 0)
     {
-        if (sectors[i].tag == tag)
+        for (thinker = thinkerclasscap[th_mobj].cnext;
+             thinker != &thinkerclasscap[th_mobj];
+             thinker = thinker->cnext)
         {
-            for (thinker = thinkercap.next; thinker != &thinkercap;
-                 thinker = thinker->next)
-            {
-                // not a mobj
-                if (thinker->function.acp1 != (actionf_p1) P_MobjThinker)
-                    continue;
-
-                m = (mobj_t *) thinker;
-
-                // not a teleportman
-                if (m->type != MT_TELEPORTMAN)
-                    continue;
-
-                sector = m->subsector->sector;
-                // wrong sector
-                if (sector - sectors != i)
-                    continue;
-
-                oldx = thing->x;
-                oldy = thing->y;
-                oldz = thing->z;
-
-                if (!P_TeleportMove(thing, m->x, m->y))
-                    return 0;
-
-                thing->z = thing->floorz;
-
-                if (thing->player)
-                    thing->player->viewz = thing->z + thing->player->viewheight;
-
-                // spawn teleport fog at source and destination
-                fog = P_SpawnMobj(oldx, oldy, oldz, MT_TFOG);
-                S_StartSound(fog, sfx_telept);
-                an = m->angle >> ANGLETOFINESHIFT;
-                fog = P_SpawnMobj(m->x + 20 * finecosine[an],
-                                  m->y + 20 * finesine[an], thing->z, MT_TFOG);
-
-                // emit sound, where?
-                S_StartSound(fog, sfx_telept);
-
-                // don't move for a bit
-                if (thing->player)
-                    thing->reactiontime = 18;
-
-                thing->angle = m->angle;
-                thing->momx = thing->momy = thing->momz = 0;
-                return 1;
-            }
+            m = (mobj_t *) thinker;
+
+            // not a teleportman
+            if (m->type != MT_TELEPORTMAN)
+                continue;
+
+            sector = m->subsector->sector;
+            // wrong sector
+            if (sector - sectors != i)
+                continue;
+
+            oldx = thing->x;
+            oldy = thing->y;
+            oldz = thing->z;
+
+            if (!P_TeleportMove(thing, m->x, m->y))
+                return 0;
+
+            thing->z = thing->floorz;
+
+            if (thing->player)
+                thing->player->viewz = thing->z + thing->player->viewheight;
+
+            // spawn teleport fog at source and destination
+            fog = P_SpawnMobj(oldx, oldy, oldz, MT_TFOG);
+            S_StartSound(fog, sfx_telept);
+            an = m->angle >> ANGLETOFINESHIFT;
+            fog = P_SpawnMobj(m->x + 20 * finecosine[an],
+                              m->y + 20 * finesine[an], thing->z, MT_TFOG);
+
+            // emit sound, where?
+            S_StartSound(fog, sfx_telept);
+
+            // don't move for a bit
+            if (thing->player)
+                thing->reactiontime = 18;
+
+            thing->angle = m->angle;
+            thing->momx = thing->momy = thing->momz = 0;
+            return 1;
         }
     }
     return 0;
@@ -18,7 +18,13 @@
 //
 
 
+#include <limits.h>
+#include <stdlib.h>
+
 #include "z_zone.h"
+#include "i_jobs.h"
+#include "i_system.h"
+#include "m_argv.h"
 #include "p_local.h"
 
 #include "doomstat.h"
@@ -28,7 +34,7 @@ int	leveltime;
 
 //
 // THINKERS
-// All thinkers should be allocated by Z_Malloc
+// All thinkers should be allocated by P_AllocateThinker
 // so they can be operated on uniformly.
 // The actual structures will vary in size,
 // but the first element must be thinker_t.
@@ -39,28 +45,207 @@ int	leveltime;
 // Both the head and tail of the thinker list.
 thinker_t	thinkercap;
 
+// Same for each class, linked through cprev/cnext.
+thinker_t	thinkerclasscap[NUMTHCLASS];
+
+
+//
+// THINKER POOLS
+// Thinkers are carved out of slabs, one pool for each size and
+//  zone tag, and freed ones are kept on a free list for reuse.
+//  The slabs are ordinary zone blocks, so they go away with the
+//  rest of the level in Z_FreeTags; the pools only have to
+//  forget about them.
+//
+
+#define MAXTHINKERPOOLS		16
+#define THINKERSPERSLAB		64
+
+typedef struct thinkerpool_s
+{
+    int		slotsize;	// header included
+    int		tag;
+    byte*	freelist;	// slots, linked through their bodies
+    byte*	slab;		// slab still being carved up
+    int		slabused;
+
+} thinkerpool_t;
+
+// Each slot starts with a pointer to its pool, so a thinker
+//  can be given back without knowing what it is.
+#define SLOTHEADER	((int) sizeof(thinkerpool_t *))
+
+static thinkerpool_t	thinkerpools[MAXTHINKERPOOLS];
+static int		numthinkerpools;
+
+
+//
+// PARALLEL LIGHTS
+// Glowing and strobing lights only read and write their own state
+//  and their own sector's light level, and never call P_Random.
+//  With -parallelthinkers they are run ahead on the job threads
+//  against a private copy of the light level.  The serial pass
+//  then commits each result at the thinker's place in the list,
+//  or runs the thinker again if something earlier in the tic has
+//  changed the light level it read, so the outcome is the same
+//  as running everything in order.
+//
+
+// Not worth waking the job threads for fewer lights than this.
+#define MINPARALLELLIGHTS	1024
+#define LIGHTSPERJOB		256
+
+typedef struct
+{
+    thinker_t*	thinker;
+    short	inlevel;
+    short	outlevel;
+
+    union
+    {
+	glow_t		glow;
+	strobe_t	strobe;
+    } state;
+
+} lightresult_t;
+
+static boolean		parallelthinkers;
+
+static lightresult_t*	lightresults;
+static int		numlightresults;
+static int		maxlightresults;
+
+
+//
+// SLEEPING THINKERS
+// A mobj that is standing still with nothing to do until its
+//  tics run out, such as a monster waiting in A_Look, an item or
+//  a corpse, is taken off the thinker list after its turn and put
+//  on the sleeper list for the tic it next has to run.  Its tics
+//  are left as they were and worked out again when it wakes.
+//
+// A woken thinker runs at its old place in the list: the walk in
+//  P_RunThinkers merges the thinkers due this tic back in by seq,
+//  so everything still happens in the same order as if nothing
+//  had slept.  Anything that disturbs a sleeping mobj from outside
+//  (P_SetMobjState, P_DamageMobj, P_RemoveThinker) wakes it first,
+//  in time for its next turn.
+//
+
+// Sleeper lists, one for each tic modulo the size, and one more
+//  for those with no wake tic.
+#define SLEEPERTICS		256
+#define NEVERWAKE		SLEEPERTICS
+
+static thinker_t	sleepers[SLEEPERTICS + 1];
+
+static boolean		dormancy;
+static int		thinkerseq;
+
+// Seq of the thinker whose turn it is.  Those below it have had
+//  their turn this tic; 0 before the walk, INT_MAX after it.
+static int		thinkerturn;
+static boolean		runningthinkers;
+
+// Woken thinkers waiting to be merged back into the list.
+typedef struct
+{
+    thinker_t**	thinkers;
+    int		count;
+    int		size;
+
+} wakelist_t;
+
+// Those to run in the current walk, in seq order from nextdue on,
+//  and those for the next walk, in any order.
+static wakelist_t	due;
+static wakelist_t	woken;
+static int		nextdue;
+
 
 //
 // P_InitThinkers
 //
 void P_InitThinkers (void)
 {
+    int		i;
+
     thinkercap.prev = thinkercap.next  = &thinkercap;
+    thinkercap.seq = INT_MAX;
+
+    for (i=0 ; i<NUMTHCLASS ; i++)
+    {
+	thinkerclasscap[i].cprev = &thinkerclasscap[i];
+	thinkerclasscap[i].cnext = &thinkerclasscap[i];
+    }
+
+    for (i=0 ; i<=SLEEPERTICS ; i++)
+	sleepers[i].prev = sleepers[i].next = &sleepers[i];
+
+    thinkerseq = 0;
+    thinkerturn = 0;
+    due.count = 0;
+    woken.count = 0;
+
+    //!
+    // @category obscure
+    //
+    // Run glowing and strobing light thinkers on worker threads.
+    // Game state stays identical to a serial run.
+    //
+
+    parallelthinkers = M_CheckParm("-parallelthinkers") > 0
+                    && I_NumJobThreads() > 1;
+
+    //!
+    // @category obscure
+    //
+    // Run every thinker every tic, rather than letting idle things
+    // sleep until they next have something to do.
+    //
+
+    dormancy = !M_CheckParm("-nodormancy");
 }
 
 
 
 
+//
+// LinkClass
+// Moves thinker to the end of a class list.
+//
+static void LinkClass (thinker_t* thinker, thclass_t tclass)
+{
+    thinker_t*	cap = &thinkerclasscap[tclass];
+
+    cap->cprev->cnext = thinker;
+    thinker->cnext = cap;
+    thinker->cprev = cap->cprev;
+    cap->cprev = thinker;
+}
+
+static void UnlinkClass (thinker_t* thinker)
+{
+    thinker->cnext->cprev = thinker->cprev;
+    thinker->cprev->cnext = thinker->cnext;
+}
+
+
 //
 // P_AddThinker
 // Adds a new thinker at the end of the list.
 //
-void P_AddThinker (thinker_t* thinker)
+void P_AddThinker (thinker_t* thinker, thclass_t tclass)
 {
+    thinker->seq = ++thinkerseq;
+    thinker->waketic = 0;
+
     thinkercap.prev->next = thinker;
     thinker->next = &thinkercap;
     thinker->prev = thinkercap.prev;
     thinkercap.prev = thinker;
+
+    LinkClass (thinker, tclass);
 }
 
 
@@ -72,21 +257,428 @@ void P_AddThinker (thinker_t* thinker)
 //
 void P_RemoveThinker (thinker_t* thinker)
 {
+  // It is freed when its turn comes.
+  if (thinker->waketic)
+      P_WakeThinker (thinker);
+
   // FIXME: NOP.
   thinker->function.acv = (actionf_v)(-1);
+
+  UnlinkClass (thinker);
+  LinkClass (thinker, th_delete);
+}
+
+
+
+//
+// SleepMobj
+// Takes a mobj that has just had its turn off the thinker list
+//  if it has nothing to do for a while.
+//
+static void SleepMobj (mobj_t* mobj)
+{
+    thinker_t*	thinker = &mobj->thinker;
+    thinker_t*	cap;
+    int		idle;
+
+    idle = P_MobjIdleTics (mobj);
+
+    if (idle == 0)
+	return;
+
+    thinker->next->prev = thinker->prev;
+    thinker->prev->next = thinker->next;
+
+    if (idle < 0)
+    {
+	thinker->waketic = -1;
+	cap = &sleepers[NEVERWAKE];
+    }
+    else
+    {
+	// The turn after the idle ones is the one that counts the
+	//  tics down to zero.
+	thinker->waketic = leveltime + idle + 1;
+	cap = &sleepers[thinker->waketic & (SLEEPERTICS - 1)];
+    }
+
+    cap->prev->next = thinker;
+    thinker->next = cap;
+    thinker->prev = cap->prev;
+    cap->prev = thinker;
+}
+
+
+//
+// CompareSeq
+//
+static int CompareSeq (const void* a, const void* b)
+{
+    return (*(thinker_t **) a)->seq - (*(thinker_t **) b)->seq;
+}
+
+
+//
+// AddWoken
+// Puts a thinker in line for its next turn.
+//
+static void AddWoken (thinker_t* thinker)
+{
+    wakelist_t*	list;
+    int		low;
+    int		high;
+    int		mid;
+
+    // Those that have had their turn this tic wait for the next.
+    list = runningthinkers && thinker->seq > thinkerturn ? &due : &woken;
+
+    if (list->count == list->size)
+    {
+	list->size = list->size ? list->size * 2 : 256;
+	list->thinkers = I_Realloc (list->thinkers,
+				    list->size * sizeof(*list->thinkers));
+    }
+
+    if (list == &woken)
+    {
+	// Sorted when the walk starts.
+	woken.thinkers[woken.count++] = thinker;
+	return;
+    }
+
+    low = nextdue;
+    high = due.count;
+
+    while (low < high)
+    {
+	mid = (low + high) / 2;
+
+	if (due.thinkers[mid]->seq < thinker->seq)
+	    low = mid + 1;
+	else
+	    high = mid;
+    }
+
+    memmove (&due.thinkers[low + 1], &due.thinkers[low],
+	     (due.count - low) * sizeof(*due.thinkers));
+    due.thinkers[low] = thinker;
+    due.count++;
+}
+
+
+//
+// P_WakeThinker
+// Gets a sleeping thinker ready for its next turn, which is this
+//  tic if it has not yet had one.
+//
+void P_WakeThinker (thinker_t* thinker)
+{
+    int		turns;
+
+    if (!thinker->waketic)
+	return;
+
+    if (thinker->waketic > 0)
+    {
+	// Turns left up to and including the one at waketic.
+	turns = thinker->waketic - leveltime;
+	if (thinker->seq > thinkerturn)
+	    turns++;
+
+	((mobj_t *) thinker)->tics = turns;
+    }
+
+    thinker->next->prev = thinker->prev;
+    thinker->prev->next = thinker->next;
+    thinker->waketic = 0;
+
+    AddWoken (thinker);
+}
+
+
+//
+// CollectDue
+// Wakes the sleepers due this tic and sorts them in with those
+//  woken since the last walk.
+//
+static void CollectDue (void)
+{
+    thinker_t*	cap = &sleepers[leveltime & (SLEEPERTICS - 1)];
+    thinker_t*	thinker;
+    thinker_t*	next;
+    wakelist_t	list;
+
+    for (thinker = cap->next ; thinker != cap ; thinker = next)
+    {
+	next = thinker->next;
+
+	if (thinker->waketic == leveltime)
+	    P_WakeThinker (thinker);
+    }
+
+    list = due;
+    due = woken;
+    woken = list;
+    woken.count = 0;
+
+    if (due.count > 1)
+	qsort (due.thinkers, due.count, sizeof(*due.thinkers), CompareSeq);
+
+    nextdue = 0;
+}
+
+
+//
+// P_WakeAllThinkers
+// Puts every thinker back on the list with its tics up to date.
+//
+void P_WakeAllThinkers (void)
+{
+    thinker_t*	thinker;
+    thinker_t*	next;
+    int		i;
+
+    for (i=0 ; i<=SLEEPERTICS ; i++)
+    {
+	for (thinker = sleepers[i].next ; thinker != &sleepers[i] ;
+	     thinker = next)
+	{
+	    next = thinker->next;
+	    P_WakeThinker (thinker);
+	}
+    }
+
+    if (woken.count > 1)
+    {
+	qsort (woken.thinkers, woken.count, sizeof(*woken.thinkers),
+	       CompareSeq);
+    }
+
+    // Merge them back in by seq.
+    thinker = thinkercap.next;
+
+    for (i=0 ; i<woken.count ; i++)
+    {
+	while (thinker->seq < woken.thinkers[i]->seq)
+	    thinker = thinker->next;
+
+	woken.thinkers[i]->next = thinker;
+	woken.thinkers[i]->prev = thinker->prev;
+	thinker->prev->next = woken.thinkers[i];
+	thinker->prev = woken.thinkers[i];
+    }
+
+    woken.count = 0;
 }
 
 
 
 //
 // P_AllocateThinker
-// Allocates memory and adds a new thinker at the end of the list.
+// Allocates memory for a thinker of the given size from the
+//  pool for that size and tag.  Like Z_Malloc, the memory is
+//  not cleared.
+//
+void* P_AllocateThinker (int size, int tag)
+{
+    thinkerpool_t*	pool;
+    byte*		slot;
+    int			slotsize;
+    int			i;
+
+    slotsize = (SLOTHEADER + size + sizeof(void *) - 1)
+             & ~(int) (sizeof(void *) - 1);
+
+    for (i=0 ; i<numthinkerpools ; i++)
+    {
+	if (thinkerpools[i].slotsize == slotsize
+	 && thinkerpools[i].tag == tag)
+	{
+	    break;
+	}
+    }
+
+    pool = &thinkerpools[i];
+
+    if (i == numthinkerpools)
+    {
+	if (numthinkerpools == MAXTHINKERPOOLS)
+	    I_Error ("P_AllocateThinker: too many thinker sizes");
+
+	numthinkerpools++;
+	pool->slotsize = slotsize;
+	pool->tag = tag;
+	pool->freelist = NULL;
+	pool->slab = NULL;
+	pool->slabused = 0;
+    }
+
+    if (pool->freelist)
+    {
+	slot = pool->freelist;
+	pool->freelist = *(byte **) (slot + SLOTHEADER);
+    }
+    else
+    {
+	if (!pool->slab || pool->slabused == THINKERSPERSLAB)
+	{
+	    pool->slab = Z_Malloc (slotsize * THINKERSPERSLAB, tag, NULL);
+	    pool->slabused = 0;
+	}
+
+	slot = pool->slab + slotsize * pool->slabused++;
+    }
+
+    *(thinkerpool_t **) slot = pool;
+
+    return slot + SLOTHEADER;
+}
+
+
+//
+// P_FreeThinker
+// Gives a thinker's memory back to its pool.
+//
+void P_FreeThinker (thinker_t* thinker)
+{
+    byte*		slot = (byte *) thinker - SLOTHEADER;
+    thinkerpool_t*	pool = *(thinkerpool_t **) slot;
+
+    *(byte **) thinker = pool->freelist;
+    pool->freelist = slot;
+}
+
+
+//
+// P_ClearThinkerPools
+// Called once the level's zone blocks have been freed.
+//
+void P_ClearThinkerPools (void)
+{
+    numthinkerpools = 0;
+}
+
+
+
 //
-void P_AllocateThinker (thinker_t*	thinker)
+// LightJob
+// Runs one batch of lights against private copies of their
+//  state and sector light level.
+//
+static void LightJob (void *data, int index)
 {
+    lightresult_t*	r;
+    lightresult_t*	end;
+    sector_t		sector;
+
+    r = lightresults + index * LIGHTSPERJOB;
+    end = r + LIGHTSPERJOB;
+
+    if (end > lightresults + numlightresults)
+	end = lightresults + numlightresults;
+
+    // Only the light level of the copy is ever looked at.
+    for ( ; r < end ; r++)
+    {
+	if (r->thinker->function.acp1 == (actionf_p1) T_Glow)
+	{
+	    r->state.glow = *(glow_t *) r->thinker;
+	    r->inlevel = r->state.glow.sector->lightlevel;
+	    sector.lightlevel = r->inlevel;
+	    r->state.glow.sector = &sector;
+	    T_Glow (&r->state.glow);
+	}
+	else
+	{
+	    r->state.strobe = *(strobe_t *) r->thinker;
+	    r->inlevel = r->state.strobe.sector->lightlevel;
+	    sector.lightlevel = r->inlevel;
+	    r->state.strobe.sector = &sector;
+	    T_StrobeFlash (&r->state.strobe);
+	}
+
+	r->outlevel = sector.lightlevel;
+    }
 }
 
 
+//
+// RunLights
+// Collects the parallel lights in list order and runs them.
+//  Returns false if there are too few to bother.
+//
+static boolean RunLights (void)
+{
+    thinker_t*	th;
+    thinker_t*	cap = &thinkerclasscap[th_light];
+
+    numlightresults = 0;
+
+    for (th = cap->cnext ; th != cap ; th = th->cnext)
+    {
+	if (th->function.acp1 != (actionf_p1) T_Glow
+	 && th->function.acp1 != (actionf_p1) T_StrobeFlash)
+	{
+	    continue;
+	}
+
+	if (numlightresults == maxlightresults)
+	{
+	    maxlightresults = maxlightresults ? maxlightresults * 2
+	                                      : MINPARALLELLIGHTS;
+	    lightresults = I_Realloc(lightresults,
+	                             maxlightresults * sizeof(*lightresults));
+	}
+
+	lightresults[numlightresults++].thinker = th;
+    }
+
+    if (numlightresults < MINPARALLELLIGHTS)
+	return false;
+
+    I_RunJobs (LightJob, NULL,
+                 (numlightresults + LIGHTSPERJOB - 1) / LIGHTSPERJOB);
+    return true;
+}
+
+
+//
+// CommitLight
+//
+static void CommitLight (lightresult_t* r)
+{
+    thinker_t*	th = r->thinker;
+    sector_t*	sector;
+
+    if (th->function.acp1 == (actionf_p1) T_Glow)
+	sector = ((glow_t *) th)->sector;
+    else
+	sector = ((strobe_t *) th)->sector;
+
+    if (sector->lightlevel != r->inlevel)
+    {
+	// Changed since the copy was taken; do it again.
+	th->function.acp1 (th);
+	return;
+    }
+
+    // The links may have moved since the copy was taken.
+    if (th->function.acp1 == (actionf_p1) T_Glow)
+    {
+	r->state.glow.thinker = *th;
+	r->state.glow.sector = sector;
+	*(glow_t *) th = r->state.glow;
+    }
+    else
+    {
+	r->state.strobe.thinker = *th;
+	r->state.strobe.sector = sector;
+	*(strobe_t *) th = r->state.strobe;
+    }
+
+    sector->lightlevel = r->outlevel;
+}
+
 
 //
 // P_RunThinkers
@@ -94,26 +686,74 @@ void P_AllocateThinker (thinker_t*	thinker)
 void P_RunThinkers (void)
 {
     thinker_t *currentthinker, *nextthinker;
+    int nextlight;
+
+    if (!parallelthinkers || !RunLights())
+	numlightresults = 0;
+
+    // Lights are committed in list order as the walk reaches them.
+    nextlight = 0;
+
+    CollectDue ();
+    runningthinkers = true;
 
     currentthinker = thinkercap.next;
-    while (currentthinker != &thinkercap)
+    while (currentthinker != &thinkercap || nextdue < due.count)
     {
+	// A woken thinker goes back in ahead of the first one
+	//  that came after it.
+	if (nextdue < due.count
+	 && due.thinkers[nextdue]->seq < currentthinker->seq)
+	{
+	    nextthinker = currentthinker;
+	    currentthinker = due.thinkers[nextdue++];
+
+	    currentthinker->next = nextthinker;
+	    currentthinker->prev = nextthinker->prev;
+	    nextthinker->prev->next = currentthinker;
+	    nextthinker->prev = currentthinker;
+	}
+
+	thinkerturn = currentthinker->seq;
+
 	if ( currentthinker->function.acv == (actionf_v)(-1) )
 	{
+	    if (nextlight < numlightresults
+	     && lightresults[nextlight].thinker == currentthinker)
+	    {
+		nextlight++;
+	    }
+
 	    // time to remove it
             nextthinker = currentthinker->next;
 	    currentthinker->next->prev = currentthinker->prev;
 	    currentthinker->prev->next = currentthinker->next;
-	    Z_Free(currentthinker);
+	    UnlinkClass (currentthinker);
+	    P_FreeThinker (currentthinker);
 	}
 	else
 	{
-	    if (currentthinker->function.acp1)
+	    if (nextlight < numlightresults
+	     && lightresults[nextlight].thinker == currentthinker)
+	    {
+		CommitLight (&lightresults[nextlight++]);
+	    }
+	    else if (currentthinker->function.acp1)
 		currentthinker->function.acp1 (currentthinker);
             nextthinker = currentthinker->next;
+
+	    if (dormancy && currentthinker->function.acp1
+	                    == (actionf_p1) P_MobjThinker)
+	    {
+		SleepMobj ((mobj_t *) currentthinker);
+	    }
 	}
 	currentthinker = nextthinker;
     }
+
+    runningthinkers = false;
+    thinkerturn = INT_MAX;
+    due.count = 0;
 }
 
 
@@ -140,6 +780,9 @@ void P_Ticker (void)
     }
     
 		
+    // Sight results only hold within a tic.
+    sightstamp++;
+
     for (i=0 ; i<MAXPLAYERS ; i++)
 	if (playeringame[i])
 	    P_PlayerThink (&players[i]);
@@ -150,4 +793,7 @@ void P_Ticker (void)
 
     // for par times
     leveltime++;	
+
+    // Nobody has had a turn in the new tic.
+    thinkerturn = 0;
 }
@@ -27,6 +27,7 @@
 
 #include "r_main.h"
 #include "r_plane.h"
+#include "r_pvs.h"
 #include "r_things.h"
 
 // State.
@@ -547,6 +548,24 @@ void R_Subsector (int num)
 
 
 
+//
+// PVSVisible
+// Checks the potentially visible set for a node or subsector.
+//
+static boolean PVSVisible (int bspnum)
+{
+    if (bspnum & NF_SUBSECTOR)
+    {
+        if (bspnum == -1)
+            return true;
+        return pvssubsectors[bspnum & ~NF_SUBSECTOR] != 0;
+    }
+
+    return pvsnodes[bspnum] != 0;
+}
+
+
+
 //
 // RenderBSPNode
 // Renders all subsectors below a given node,
@@ -557,6 +576,10 @@ void R_RenderBSPNode (int bspnum)
     node_t*	bsp;
     int		side;
 
+    // Nothing below here can be seen from the view sector?
+    if (pvsmatrix && !PVSVisible(bspnum))
+	return;
+
     // Found a subsector?
     if (bspnum & NF_SUBSECTOR)
     {
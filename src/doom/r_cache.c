@@ -0,0 +1,293 @@
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	On-disk cache of render data derived from the WAD files.
+//
+//	The file is named after the W_Checksum digest of the WAD
+//	directory and holds each section back to back after a small
+//	header.  The directory digest only covers lump names and
+//	sizes, so the header also carries a digest of the path,
+//	length and modification time of every WAD file loaded, which
+//	notices a WAD edited in place without reading any of it.
+//	It is only ever read by the machine that wrote it, so the
+//	data is stored in native byte order; the header records
+//	enough to reject a file from a different build.
+//
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "z_zone.h"
+#include "m_argv.h"
+#include "m_config.h"
+#include "m_misc.h"
+#include "sha1.h"
+#include "w_checksum.h"
+#include "w_wad.h"
+
+#include "r_defs.h"
+#include "r_cache.h"
+
+#define RC_MAGIC "LHRC"
+#define RC_VERSION 3
+#define RC_BYTEORDER 0x01020304
+
+typedef struct
+{
+    char magic[4];
+    int version;
+    int byteorder;
+    int framesize;
+    sha1_digest_t digest;
+    sha1_digest_t files;
+    unsigned int numlumps;
+    int lengths[RC_NUMSECTIONS];
+} rcheader_t;
+
+static char *cachefile;
+static byte *cachedata;
+static byte *sections[RC_NUMSECTIONS];
+static int lengths[RC_NUMSECTIONS];
+
+static byte *stored[RC_NUMSECTIONS];
+static int storedlengths[RC_NUMSECTIONS];
+static rcheader_t header;
+
+//
+// ChecksumFiles
+// Digest of where every loaded WAD file is, how long it is and
+// when it was last written.
+//
+static void ChecksumFiles(sha1_digest_t digest)
+{
+    sha1_context_t context;
+    wad_file_t *wad;
+    struct stat st;
+    unsigned int i;
+
+    SHA1_Init(&context);
+
+    // Lumps from the same file are next to each other.
+    wad = NULL;
+
+    for (i = 0; i < numlumps; i++)
+    {
+        if (lumpinfo[i]->wad_file == wad)
+        {
+            continue;
+        }
+
+        wad = lumpinfo[i]->wad_file;
+
+        SHA1_Update(&context, (byte *) wad->path, strlen(wad->path) + 1);
+        SHA1_UpdateInt32(&context, wad->length);
+
+        if (M_stat(wad->path, &st) == 0)
+        {
+            SHA1_UpdateInt32(&context, (unsigned int) st.st_mtime);
+            SHA1_UpdateInt32(&context,
+                             (unsigned int) ((long long) st.st_mtime >> 32));
+        }
+        else
+        {
+            SHA1_UpdateInt32(&context, 0xffffffff);
+        }
+    }
+
+    SHA1_Final(digest, &context);
+}
+
+//
+// R_OpenRenderCache
+//
+void R_OpenRenderCache(void)
+{
+    char name[64];
+    byte *data;
+    byte *p;
+    int filelength;
+    int expected;
+    int i;
+
+    cachefile = NULL;
+    cachedata = NULL;
+    memset(sections, 0, sizeof(sections));
+    memset(stored, 0, sizeof(stored));
+
+    //!
+    // @category obscure
+    //
+    // Rebuild the render lookup tables on startup rather than
+    // loading them from the cache file in the config directory.
+    //
+
+    if (M_CheckParm("-norendercache"))
+    {
+        return;
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, RC_MAGIC, sizeof(header.magic));
+    header.version = RC_VERSION;
+    header.byteorder = RC_BYTEORDER;
+    header.framesize = sizeof(spriteframe_t);
+    header.numlumps = numlumps;
+    W_Checksum(header.digest);
+    ChecksumFiles(header.files);
+
+    M_StringCopy(name, "render-", sizeof(name));
+    for (i = 0; i < (int) sizeof(header.digest); i++)
+    {
+        M_snprintf(name + 7 + i * 2, sizeof(name) - 7 - i * 2,
+                   "%02x", header.digest[i]);
+    }
+    M_StringConcat(name, ".cache", sizeof(name));
+
+    cachefile = M_StringJoin(configdir, name, NULL);
+
+    if (!M_FileExists(cachefile))
+    {
+        return;
+    }
+
+    filelength = M_ReadFile(cachefile, &data);
+
+    // Everything is checked up front against the header, so a
+    // section handed out later never needs checking again.  A file
+    // written before a WAD was changed fails here and is replaced
+    // by R_CloseRenderCache.
+    if (filelength < (int) sizeof(rcheader_t)
+     || memcmp(data, &header, offsetof(rcheader_t, lengths)) != 0)
+    {
+        Z_Free(data);
+        return;
+    }
+
+    memcpy(header.lengths, ((rcheader_t *) data)->lengths,
+           sizeof(header.lengths));
+
+    expected = sizeof(rcheader_t);
+    for (i = 0; i < RC_NUMSECTIONS; i++)
+    {
+        if (header.lengths[i] < 0)
+        {
+            Z_Free(data);
+            return;
+        }
+        expected += header.lengths[i];
+    }
+
+    if (filelength != expected)
+    {
+        Z_Free(data);
+        return;
+    }
+
+    cachedata = data;
+    p = data + sizeof(rcheader_t);
+
+    for (i = 0; i < RC_NUMSECTIONS; i++)
+    {
+        sections[i] = p;
+        lengths[i] = header.lengths[i];
+        p += lengths[i];
+    }
+}
+
+//
+// R_CacheSection
+//
+void *R_CacheSection(rcsection_t section, int *length)
+{
+    *length = lengths[section];
+    return sections[section];
+}
+
+//
+// R_StoreCacheSection
+//
+void R_StoreCacheSection(rcsection_t section, const void *data, int length)
+{
+    if (cachefile == NULL)
+    {
+        return;
+    }
+
+    stored[section] = Z_Malloc(length, PU_STATIC, NULL);
+    storedlengths[section] = length;
+    memcpy(stored[section], data, length);
+}
+
+//
+// R_CloseRenderCache
+//
+void R_CloseRenderCache(void)
+{
+    byte *data;
+    byte *p;
+    int length;
+    int i;
+
+    length = sizeof(rcheader_t);
+
+    for (i = 0; i < RC_NUMSECTIONS; i++)
+    {
+        if (stored[i] == NULL)
+        {
+            break;
+        }
+
+        header.lengths[i] = storedlengths[i];
+        length += storedlengths[i];
+    }
+
+    if (cachefile != NULL && i == RC_NUMSECTIONS)
+    {
+        data = Z_Malloc(length, PU_STATIC, NULL);
+        memcpy(data, &header, sizeof(rcheader_t));
+        p = data + sizeof(rcheader_t);
+
+        for (i = 0; i < RC_NUMSECTIONS; i++)
+        {
+            memcpy(p, stored[i], storedlengths[i]);
+            p += storedlengths[i];
+        }
+
+        if (!M_WriteFile(cachefile, data, length))
+        {
+            printf("R_CloseRenderCache: unable to write %s\n", cachefile);
+        }
+
+        Z_Free(data);
+    }
+
+    for (i = 0; i < RC_NUMSECTIONS; i++)
+    {
+        if (stored[i] != NULL)
+        {
+            Z_Free(stored[i]);
+        }
+        stored[i] = NULL;
+        sections[i] = NULL;
+    }
+
+    if (cachedata != NULL)
+    {
+        Z_Free(cachedata);
+    }
+
+    free(cachefile);
+    cachedata = NULL;
+    cachefile = NULL;
+}
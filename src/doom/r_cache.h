@@ -0,0 +1,44 @@
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	On-disk cache of render data derived from the WAD files.
+//
+
+
+#ifndef __R_CACHE__
+#define __R_CACHE__
+
+typedef enum
+{
+    RC_TEXTURES, // column lookups from R_GenerateLookup
+    RC_SPRITES,  // frames from R_InitSpriteDefs
+
+    RC_NUMSECTIONS
+} rcsection_t;
+
+// Called before any section is used.  Finds the cache file for
+// the loaded WADs and checks that it is complete.
+void R_OpenRenderCache(void);
+
+// Returns the cached data for a section, or NULL if there
+// is no valid cache and the data must be rebuilt.
+void *R_CacheSection(rcsection_t section, int *length);
+
+// Hands over rebuilt data to be written out by R_CloseRenderCache.
+void R_StoreCacheSection(rcsection_t section, const void *data,
+                         int length);
+
+// Writes the cache file if every section was rebuilt, and
+// frees the cached data.
+void R_CloseRenderCache(void);
+
+#endif
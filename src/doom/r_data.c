@@ -18,9 +18,13 @@
 //
 
 #include <stdio.h>
+#include <stdlib.h>
 
+#include "i_jobs.h"
 #include "i_swap.h"
 #include "i_system.h"
+#include "i_timer.h"
+#include "m_argv.h"
 #include "z_zone.h"
 
 #include "w_wad.h"
@@ -31,6 +35,7 @@
 #include "p_local.h"
 
 #include "doomstat.h"
+#include "r_cache.h"
 #include "r_sky.h"
 
 #include "r_data.h"
@@ -285,8 +290,22 @@ void R_GenerateComposite (int texnum)
 
 //
 // R_GenerateLookup
+// Safe to run as a job: the patches are looked up in patchdata
+//  rather than through the WAD cache, and any problem is returned
+//  to be reported by the caller in texture order.
 //
-void R_GenerateLookup (int texnum)
+typedef enum
+{
+    LOOKUP_OK,
+    LOOKUP_NOPATCH,	// a column has no patch
+    LOOKUP_TOOBIG,	// composite would be over 64k
+    LOOKUP_NOMEMORY	// could not allocate the column counts
+} lookupresult_t;
+
+static lookupresult_t
+R_GenerateLookup
+( int		texnum,
+  patch_t**	patchdata )
 {
     texture_t*		texture;
     byte*		patchcount;	// patchcount[texture->width]
@@ -298,6 +317,7 @@ void R_GenerateLookup (int texnum)
     int			i;
     short*		collump;
     unsigned short*	colofs;
+    lookupresult_t	result;
 	
     texture = textures[texnum];
 
@@ -312,14 +332,17 @@ void R_GenerateLookup (int texnum)
     //  that are covered by more than one patch.
     // Fill in the lump / offset, so columns
     //  with only a single patch are all done.
-    patchcount = (byte *) Z_Malloc(texture->width, PU_STATIC, &patchcount);
-    memset (patchcount, 0, texture->width);
+    // This may run on a job thread, so no Z_Malloc.
+    patchcount = calloc(texture->width, 1);
+
+    if (patchcount == NULL)
+	return LOOKUP_NOMEMORY;
 
     for (i=0 , patch = texture->patches;
 	 i<texture->patchcount;
 	 i++, patch++)
     {
-	realpatch = W_CacheLumpNum (patch->patch, PU_CACHE);
+	realpatch = patchdata[patch->patch];
 	x1 = patch->originx;
 	x2 = x1 + SHORT(realpatch->width);
 	
@@ -337,14 +360,15 @@ void R_GenerateLookup (int texnum)
 	    colofs[x] = LONG(realpatch->columnofs[x-x1])+3;
 	}
     }
+
+    result = LOOKUP_OK;
 	
     for (x=0 ; x<texture->width ; x++)
     {
 	if (!patchcount[x])
 	{
-	    printf ("R_GenerateLookup: column without a patch (%s)\n",
-		    texture->name);
-	    return;
+	    result = LOOKUP_NOPATCH;
+	    break;
 	}
 	// I_Error ("R_GenerateLookup: column without a patch");
 	
@@ -356,15 +380,225 @@ void R_GenerateLookup (int texnum)
 	    
 	    if (texturecompositesize[texnum] > 0x10000-texture->height)
 	    {
-		I_Error ("R_GenerateLookup: texture %i is >64k",
-			 texnum);
+		result = LOOKUP_TOOBIG;
+		break;
 	    }
 	    
 	    texturecompositesize[texnum] += texture->height;
 	}
     }
 
-    Z_Free(patchcount);
+    free(patchcount);
+
+    return result;
+}
+
+
+typedef struct
+{
+    patch_t**		patchdata;
+    lookupresult_t*	results;
+} lookupjob_t;
+
+static void GenerateLookupJob (void *data, int texnum)
+{
+    lookupjob_t*	job = data;
+
+    job->results[texnum] = R_GenerateLookup(texnum, job->patchdata);
+}
+
+static lookupjob_t	lookupjob;
+
+
+//
+// StartLookups
+// Caches every patch used by a texture and starts generating
+//  the column lookups in the background.
+//
+static void StartLookups (void)
+{
+    texture_t*		texture;
+    int			lump;
+    int			i;
+    int			j;
+
+    lookupjob.patchdata = Z_Malloc(numlumps * sizeof(*lookupjob.patchdata),
+				   PU_STATIC, NULL);
+    memset(lookupjob.patchdata, 0, numlumps * sizeof(*lookupjob.patchdata));
+    lookupjob.results = Z_Malloc(numtextures * sizeof(*lookupjob.results),
+				 PU_STATIC, NULL);
+
+    for (i=0 ; i<numtextures ; i++)
+    {
+	texture = textures[i];
+
+	for (j=0 ; j<texture->patchcount ; j++)
+	{
+	    lump = texture->patches[j].patch;
+
+	    if (lookupjob.patchdata[lump] == NULL)
+		lookupjob.patchdata[lump] = W_CacheLumpNum(lump, PU_STATIC);
+	}
+    }
+
+    I_StartJobs(GenerateLookupJob, &lookupjob, numtextures);
+}
+
+
+//
+// CachedLookups
+// Fills in the lookups from the render cache, if it holds
+//  them for exactly this set of textures.
+// The section is laid out as compositesize and result for each
+//  texture, then every texture's column lumps, then offsets.
+//
+static boolean CachedLookups (void)
+{
+    byte*	data;
+    int		length;
+    int		columns;
+    int		i;
+    int		width;
+
+    data = R_CacheSection(RC_TEXTURES, &length);
+
+    if (data == NULL)
+	return false;
+
+    columns = 0;
+    for (i=0 ; i<numtextures ; i++)
+	columns += textures[i]->width;
+
+    if (length != numtextures * 2 * sizeof(int)
+		+ columns * (sizeof(short) + sizeof(unsigned short)))
+    {
+	return false;
+    }
+
+    lookupjob.patchdata = NULL;
+    lookupjob.results = Z_Malloc(numtextures * sizeof(*lookupjob.results),
+				 PU_STATIC, NULL);
+
+    for (i=0 ; i<numtextures ; i++)
+    {
+	texturecomposite[i] = 0;
+	memcpy(&texturecompositesize[i], data, sizeof(int));
+	data += sizeof(int);
+	memcpy(&lookupjob.results[i], data, sizeof(int));
+	data += sizeof(int);
+    }
+
+    for (i=0 ; i<numtextures ; i++)
+    {
+	width = textures[i]->width;
+	memcpy(texturecolumnlump[i], data, width * sizeof(short));
+	data += width * sizeof(short);
+    }
+
+    for (i=0 ; i<numtextures ; i++)
+    {
+	width = textures[i]->width;
+	memcpy(texturecolumnofs[i], data, width * sizeof(unsigned short));
+	data += width * sizeof(unsigned short);
+    }
+
+    return true;
+}
+
+
+//
+// StoreLookups
+// Hands the lookups to the render cache, in the layout
+//  CachedLookups expects.
+//
+static void StoreLookups (void)
+{
+    byte*	data;
+    byte*	p;
+    int		length;
+    int		columns;
+    int		result;
+    int		width;
+    int		i;
+
+    columns = 0;
+    for (i=0 ; i<numtextures ; i++)
+	columns += textures[i]->width;
+
+    length = numtextures * 2 * sizeof(int)
+	   + columns * (sizeof(short) + sizeof(unsigned short));
+    data = p = Z_Malloc(length, PU_STATIC, NULL);
+
+    for (i=0 ; i<numtextures ; i++)
+    {
+	result = lookupjob.results[i];
+	memcpy(p, &texturecompositesize[i], sizeof(int));
+	p += sizeof(int);
+	memcpy(p, &result, sizeof(int));
+	p += sizeof(int);
+    }
+
+    for (i=0 ; i<numtextures ; i++)
+    {
+	width = textures[i]->width;
+	memcpy(p, texturecolumnlump[i], width * sizeof(short));
+	p += width * sizeof(short);
+    }
+
+    for (i=0 ; i<numtextures ; i++)
+    {
+	width = textures[i]->width;
+	memcpy(p, texturecolumnofs[i], width * sizeof(unsigned short));
+	p += width * sizeof(unsigned short);
+    }
+
+    R_StoreCacheSection(RC_TEXTURES, data, length);
+    Z_Free(data);
+}
+
+
+//
+// FinishLookups
+// Waits for the lookups and reports any problems
+//  in the same order as a serial pass would.
+//
+static void FinishLookups (void)
+{
+    int		i;
+
+    I_FinishJobs();
+
+    for (i=0 ; i<numtextures ; i++)
+    {
+	if (lookupjob.results[i] == LOOKUP_NOPATCH)
+	{
+	    printf ("R_GenerateLookup: column without a patch (%s)\n",
+		    textures[i]->name);
+	}
+	else if (lookupjob.results[i] == LOOKUP_TOOBIG)
+	{
+	    I_Error ("R_GenerateLookup: texture %i is >64k", i);
+	}
+	else if (lookupjob.results[i] == LOOKUP_NOMEMORY)
+	{
+	    I_Error ("R_GenerateLookup: out of memory");
+	}
+    }
+
+    // Lookups from the cache needed no patches.
+    if (lookupjob.patchdata != NULL)
+    {
+	for (i=0 ; i<numlumps ; i++)
+	{
+	    if (lookupjob.patchdata[i] != NULL)
+		W_ReleaseLumpNum(i);
+	}
+
+	Z_Free(lookupjob.patchdata);
+	StoreLookups();
+    }
+
+    Z_Free(lookupjob.results);
 }
 
 
@@ -600,10 +834,11 @@ void R_InitTextures (void)
     if (maptex2)
         W_ReleaseLumpName("TEXTURE2");
     
-    // Precalculate whatever possible.	
-
-    for (i=0 ; i<numtextures ; i++)
-	R_GenerateLookup (i);
+    // Precalculate whatever possible.  The lookups run as jobs
+    //  while the rest of R_InitData carries on; FinishLookups
+    //  collects them.
+    if (!CachedLookups ())
+	StartLookups ();
     
     // Create translation table for global animation.
     texturetranslation = Z_Malloc ((numtextures+1)*sizeof(*texturetranslation), PU_STATIC, 0);
@@ -691,13 +926,43 @@ void R_InitColormaps (void)
 //
 void R_InitData (void)
 {
+    int		times[5];
+
+    times[0] = I_GetTimeMS();
+    R_OpenRenderCache ();
     R_InitTextures ();
     printf (".");
+    times[1] = I_GetTimeMS();
     R_InitFlats ();
     printf (".");
+    R_InitColormaps ();
+    times[2] = I_GetTimeMS();
+
+    // The texture lookups have been running alongside the phases
+    //  above, which only use the zone on this thread and never
+    //  touch a patch.  Sprites can share lumps with textures, and
+    //  R_InitSpriteLumps would retag them PU_CACHE while a job
+    //  still reads them, so it waits for the lookups.
+    FinishLookups ();
+    times[3] = I_GetTimeMS();
     R_InitSpriteLumps ();
     printf (".");
-    R_InitColormaps ();
+    times[4] = I_GetTimeMS();
+
+    //!
+    // @category obscure
+    //
+    // Print how long each startup phase took.
+    //
+
+    if (M_CheckParm("-timestartup"))
+    {
+	printf ("\nR_InitData: textures %i ms, flats and colormaps "
+		"%i ms, lookups %i ms (%i threads), sprite lumps %i ms",
+		times[1] - times[0], times[2] - times[1],
+		times[3] - times[2], I_NumJobThreads(),
+		times[4] - times[3]);
+    }
 }
 
 
@@ -869,10 +1134,11 @@ void R_PrecacheLevel (void)
     spritepresent = Z_Malloc(numsprites, PU_STATIC, NULL);
     memset (spritepresent,0, numsprites);
 	
-    for (th = thinkercap.next ; th != &thinkercap ; th=th->next)
+    for (th = thinkerclasscap[th_mobj].cnext ;
+         th != &thinkerclasscap[th_mobj] ;
+         th = th->cnext)
     {
-	if (th->function.acp1 == (actionf_p1)P_MobjThinker)
-	    spritepresent[((mobj_t *)th)->sprite] = 1;
+	spritepresent[((mobj_t *)th)->sprite] = 1;
     }
 	
     spritememory = 0;
@@ -107,6 +107,9 @@ typedef	struct
     // 0 = untraversed, 1,2 = sndlines -1
     int		soundtraversed;
 
+    // planecount when the floor or ceiling last moved
+    int		planestamp;
+
     // thing that made a sound (or null)
     mobj_t*	soundtarget;
 
@@ -127,6 +130,18 @@ typedef	struct
 
     int			linecount;
     struct line_s**	lines;	// [linecount] size
+
+    // The two-sided lines of lines[], in the same order, with the
+    //  sector on their far side.  All sectors share one buffer.
+    int			adjcount;
+    struct sectoradj_s*	adj;	// [adjcount] size
+
+    // Tag chains, see P_FindSectorFromLineTag.
+    // firsttag heads the chain of sectors whose tag hashes
+    //  to this sector's number, nexttag links the chain
+    //  in ascending order; -1 ends it.
+    int		firsttag;
+    int		nexttag;
     
 } sector_t;
 
@@ -211,6 +226,22 @@ typedef struct line_s
 } line_t;
 
 
+//
+// A neighbour of a sector, across one of its two-sided lines.
+//
+typedef struct sectoradj_s
+{
+    line_t*	line;
+    sector_t*	sector;
+
+    // Whether sound passes the line, as of planecount openstamp;
+    //  stale once either sector's planestamp is newer.
+    int		openstamp;
+    boolean	open;
+
+} sectoradj_t;
+
+
 
 
 //
@@ -223,8 +254,8 @@ typedef struct line_s
 typedef struct subsector_s
 {
     sector_t*	sector;
-    short	numlines;
-    short	firstline;
+    int		numlines;
+    int		firstline;
     
 } subsector_t;
 
@@ -270,7 +301,7 @@ typedef struct
     fixed_t	bbox[2][4];
 
     // If NF_SUBSECTOR its a subsector.
-    unsigned short children[2];
+    int		children[2];
     
 } node_t;
 
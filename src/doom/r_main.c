@@ -33,6 +33,7 @@
 #include "m_menu.h"
 
 #include "r_local.h"
+#include "r_pvs.h"
 #include "r_sky.h"
 
 
@@ -835,6 +836,8 @@ void R_SetupFrame (player_t* player)
     viewcos = finecosine[viewangle>>ANGLETOFINESHIFT];
 	
     sscount = 0;
+
+    R_SetupPVS (player->mo->subsector->sector);
 	
     if (player->fixedcolormap)
     {
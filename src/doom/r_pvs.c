@@ -0,0 +1,508 @@
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Potentially visible set, built at level load.
+//
+//	Sectors are the cells and two-sided linedefs the portals
+//	between them.  Every two-sided line is treated as open, since
+//	doors and lifts move; one-sided lines are the only occluders.
+//	A sector is potentially visible from another if some straight
+//	line stabs a chain of portals leading from one to the other,
+//	found by the usual portal flow: the next portal is clipped to
+//	the wedge seen from the source portal through the pass portal.
+//	The result is conservative; when in doubt a sector is visible.
+//
+
+#include <math.h>
+#include <string.h>
+
+#include "z_zone.h"
+#include "i_system.h"
+#include "i_timer.h"
+#include "m_argv.h"
+
+#include "doomstat.h"
+#include "r_state.h"
+#include "r_pvs.h"
+
+// Give up on a source sector after this many portal clips
+// and mark everything visible from it.
+#define PVS_MAXWORK 0x10000
+#define PVS_MAXDEPTH 256
+
+// Slack for the side tests, in map units.  Always errs towards
+// keeping a portal, never towards clipping it away.
+#define PVS_EPSILON (1.0 / 16)
+
+typedef struct
+{
+    double x1;
+    double y1;
+    double x2;
+    double y2;
+} pvsportal_t;
+
+byte *pvsmatrix;
+byte *pvsnodes;
+byte *pvssubsectors;
+
+static sector_t *pvsviewsector;
+
+static double pvsepsilon;
+static byte *pvsrow;
+static byte *pvsonstack;
+static int pvswork;
+static int pvsoverflow;
+
+//
+// PortalForLine
+//
+static void PortalForLine(line_t *li, pvsportal_t *p)
+{
+    p->x1 = (double) li->v1->x / FRACUNIT;
+    p->y1 = (double) li->v1->y / FRACUNIT;
+    p->x2 = (double) li->v2->x / FRACUNIT;
+    p->y2 = (double) li->v2->y / FRACUNIT;
+}
+
+//
+// LineSide
+// Signed distance of (x,y) from the line through (x1,y1)-(x2,y2),
+// reduced to -1, 0 or 1.
+//
+static int LineSide(double x1, double y1, double x2, double y2,
+                    double x, double y)
+{
+    double dx = x2 - x1;
+    double dy = y2 - y1;
+    double len = sqrt(dx * dx + dy * dy);
+    double dist;
+
+    if (len == 0)
+    {
+        return 0;
+    }
+
+    dist = (dx * (y - y1) - dy * (x - x1)) / len;
+
+    if (dist > pvsepsilon)
+    {
+        return 1;
+    }
+    if (dist < -pvsepsilon)
+    {
+        return -1;
+    }
+    return 0;
+}
+
+//
+// ClipPortal
+// Keeps the part of p on the given side of the line, plus the
+// epsilon band.  Returns false if nothing is left.
+//
+static boolean ClipPortal(pvsportal_t *p, double x1, double y1,
+                          double x2, double y2, int keepside)
+{
+    double dx = x2 - x1;
+    double dy = y2 - y1;
+    double len = sqrt(dx * dx + dy * dy);
+    double d1;
+    double d2;
+    double frac;
+    double ix;
+    double iy;
+
+    if (len == 0)
+    {
+        return true;
+    }
+
+    d1 = keepside * (dx * (p->y1 - y1) - dy * (p->x1 - x1)) / len
+       + pvsepsilon;
+    d2 = keepside * (dx * (p->y2 - y1) - dy * (p->x2 - x1)) / len
+       + pvsepsilon;
+
+    if (d1 >= 0 && d2 >= 0)
+    {
+        return true;
+    }
+    if (d1 < 0 && d2 < 0)
+    {
+        return false;
+    }
+
+    frac = d1 / (d1 - d2);
+    ix = p->x1 + frac * (p->x2 - p->x1);
+    iy = p->y1 + frac * (p->y2 - p->y1);
+
+    if (d1 < 0)
+    {
+        p->x1 = ix;
+        p->y1 = iy;
+    }
+    else
+    {
+        p->x2 = ix;
+        p->y2 = iy;
+    }
+
+    return true;
+}
+
+//
+// ClipToWedge
+// Clips target to the region that can be seen from source
+// through pass.  Returns false if the target is hidden.
+//
+static boolean ClipToWedge(pvsportal_t *source, pvsportal_t *pass,
+                           pvsportal_t *target)
+{
+    double sx[2];
+    double sy[2];
+    double px[2];
+    double py[2];
+    int s1;
+    int s2;
+    int sourceside;
+    int i;
+    int j;
+    int sa;
+    int sp;
+
+    sx[0] = source->x1;
+    sy[0] = source->y1;
+    sx[1] = source->x2;
+    sy[1] = source->y2;
+    px[0] = pass->x1;
+    py[0] = pass->y1;
+    px[1] = pass->x2;
+    py[1] = pass->y2;
+
+    // The source must lie wholly to one side of the pass portal,
+    // otherwise there is no wedge to clip against.
+    s1 = LineSide(px[0], py[0], px[1], py[1], sx[0], sy[0]);
+    s2 = LineSide(px[0], py[0], px[1], py[1], sx[1], sy[1]);
+
+    if (s1 == -s2)
+    {
+        return true;
+    }
+
+    sourceside = s1 ? s1 : s2;
+
+    // Anything seen through the pass portal is beyond it.
+    if (!ClipPortal(target, px[0], py[0], px[1], py[1], -sourceside))
+    {
+        return false;
+    }
+
+    // Separating lines run from an end of the source to an end of
+    // the pass portal, with the two portals on opposite sides.
+    for (i = 0; i < 2; i++)
+    {
+        for (j = 0; j < 2; j++)
+        {
+            if (fabs(sx[i] - px[j]) < pvsepsilon
+             && fabs(sy[i] - py[j]) < pvsepsilon)
+            {
+                continue;
+            }
+
+            sa = LineSide(sx[i], sy[i], px[j], py[j],
+                          sx[i ^ 1], sy[i ^ 1]);
+            sp = LineSide(sx[i], sy[i], px[j], py[j],
+                          px[j ^ 1], py[j ^ 1]);
+
+            if (sa * sp > 0 || (sa == 0 && sp == 0))
+            {
+                continue;
+            }
+
+            if (!ClipPortal(target, sx[i], sy[i], px[j], py[j],
+                            sp ? sp : -sa))
+            {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+//
+// RecursiveFlow
+// Marks sectornum visible and continues through its portals.
+// pass is the portal just crossed into this sector and source
+// the (narrowed) first portal of the chain; either may be NULL
+// near the start of the chain.
+//
+static void RecursiveFlow(int sectornum, pvsportal_t *source,
+                          pvsportal_t *pass, int depth)
+{
+    sector_t *sector;
+    line_t *li;
+    sector_t *other;
+    pvsportal_t target;
+    pvsportal_t newsource;
+    int othernum;
+    int i;
+
+    pvsrow[sectornum >> 3] |= 1 << (sectornum & 7);
+
+    if (pvsoverflow)
+    {
+        return;
+    }
+
+    if (++pvswork > PVS_MAXWORK || depth > PVS_MAXDEPTH)
+    {
+        pvsoverflow = true;
+        return;
+    }
+
+    sector = &sectors[sectornum];
+    pvsonstack[sectornum] = 1;
+
+    for (i = 0; i < sector->linecount; i++)
+    {
+        li = sector->lines[i];
+
+        if (!li->backsector || li->backsector == li->frontsector)
+        {
+            continue;
+        }
+
+        other = li->frontsector == sector ? li->backsector
+                                          : li->frontsector;
+        othernum = other - sectors;
+
+        if (pvsonstack[othernum])
+        {
+            continue;
+        }
+
+        PortalForLine(li, &target);
+
+        if (pass == NULL)
+        {
+            RecursiveFlow(othernum, NULL, &target, depth + 1);
+        }
+        else if (source == NULL)
+        {
+            newsource = *pass;
+            RecursiveFlow(othernum, &newsource, &target, depth + 1);
+        }
+        else
+        {
+            if (!ClipToWedge(source, pass, &target))
+            {
+                continue;
+            }
+
+            // Narrow the source to what can see the new portal.
+            newsource = *source;
+            if (!ClipToWedge(&target, pass, &newsource))
+            {
+                continue;
+            }
+
+            RecursiveFlow(othernum, &newsource, &target, depth + 1);
+        }
+
+        if (pvsoverflow)
+        {
+            break;
+        }
+    }
+
+    pvsonstack[sectornum] = 0;
+}
+
+//
+// R_SectorVisibility
+//
+int R_SectorVisibility(byte *matrix, double epsilon)
+{
+    int rowbytes;
+    int overflows;
+    int i;
+    int j;
+
+    // "Glass hack" lines are drawn as two-sided with nothing known
+    // about what is behind them, so the flow cannot follow them.
+    for (i = 0; i < numlines; i++)
+    {
+        if ((lines[i].flags & ML_TWOSIDED) && !lines[i].backsector)
+        {
+            return -1;
+        }
+    }
+
+    pvsepsilon = epsilon;
+
+    rowbytes = (numsectors + 7) / 8;
+    pvsrow = Z_Malloc(rowbytes, PU_STATIC, NULL);
+    pvsonstack = Z_Malloc(numsectors, PU_STATIC, NULL);
+    memset(matrix, 0, (numsectors * numsectors + 7) / 8);
+    memset(pvsonstack, 0, numsectors);
+
+    overflows = 0;
+
+    for (i = 0; i < numsectors; i++)
+    {
+        memset(pvsrow, 0, rowbytes);
+        pvswork = 0;
+        pvsoverflow = false;
+
+        RecursiveFlow(i, NULL, NULL, 0);
+
+        if (pvsoverflow)
+        {
+            memset(pvsrow, 0xff, rowbytes);
+            memset(pvsonstack, 0, numsectors);
+            overflows++;
+        }
+
+        // Rows are packed back to back, as in REJECT.
+        for (j = 0; j < numsectors; j++)
+        {
+            if (pvsrow[j >> 3] & (1 << (j & 7)))
+            {
+                int pnum = i * numsectors + j;
+
+                matrix[pnum >> 3] |= 1 << (pnum & 7);
+            }
+        }
+    }
+
+    Z_Free(pvsrow);
+    Z_Free(pvsonstack);
+
+    return overflows;
+}
+
+//
+// R_BuildPVS
+//
+void R_BuildPVS(void)
+{
+    int starttime;
+    int overflows;
+    int visible;
+    int i;
+
+    pvsmatrix = NULL;
+    pvsnodes = NULL;
+    pvssubsectors = NULL;
+    pvsviewsector = NULL;
+
+    //!
+    // Build a potentially visible set for each level at load time,
+    // letting the renderer skip BSP subtrees hidden behind solid
+    // walls.
+    //
+
+    if (!M_CheckParm("-pvs"))
+    {
+        return;
+    }
+
+    starttime = I_GetTimeMS();
+
+    pvsmatrix = Z_Malloc((numsectors * numsectors + 7) / 8,
+                         PU_LEVEL, &pvsmatrix);
+    overflows = R_SectorVisibility(pvsmatrix, PVS_EPSILON);
+
+    if (overflows < 0)
+    {
+        printf("R_BuildPVS: two-sided line without a back sector, "
+               "PVS disabled\n");
+        Z_Free(pvsmatrix);
+        pvsmatrix = NULL;
+        return;
+    }
+
+    visible = 0;
+    for (i = 0; i < numsectors * numsectors; i++)
+    {
+        if (pvsmatrix[i >> 3] & (1 << (i & 7)))
+        {
+            visible++;
+        }
+    }
+
+    pvsnodes = Z_Malloc(numnodes ? numnodes : 1, PU_LEVEL, &pvsnodes);
+    pvssubsectors = Z_Malloc(numsubsectors, PU_LEVEL, &pvssubsectors);
+
+    printf("R_BuildPVS: %i sectors, %i%% visible, %i unbounded, "
+           "%i ms\n", numsectors,
+           numsectors ? (int) ((visible * 100LL)
+                               / ((long long) numsectors * numsectors))
+                      : 0,
+           overflows, I_GetTimeMS() - starttime);
+}
+
+//
+// MarkNode
+// Returns nonzero if anything below bspnum is visible.
+//
+static byte MarkNode(int bspnum)
+{
+    node_t *bsp;
+    byte vis;
+
+    if (bspnum & NF_SUBSECTOR)
+    {
+        if (bspnum == -1)
+        {
+            return 1;
+        }
+        return pvssubsectors[bspnum & ~NF_SUBSECTOR];
+    }
+
+    bsp = &nodes[bspnum];
+    vis = MarkNode(bsp->children[0]);
+    vis |= MarkNode(bsp->children[1]);
+    pvsnodes[bspnum] = vis;
+
+    return vis;
+}
+
+//
+// R_SetupPVS
+//
+void R_SetupPVS(sector_t *viewsector)
+{
+    int row;
+    int pnum;
+    int i;
+
+    if (!pvsmatrix || viewsector == pvsviewsector)
+    {
+        return;
+    }
+
+    pvsviewsector = viewsector;
+    row = (viewsector - sectors) * numsectors;
+
+    for (i = 0; i < numsubsectors; i++)
+    {
+        pnum = row + (subsectors[i].sector - sectors);
+        pvssubsectors[i] = (pvsmatrix[pnum >> 3] >> (pnum & 7)) & 1;
+    }
+
+    if (numnodes)
+    {
+        MarkNode(numnodes - 1);
+    }
+}
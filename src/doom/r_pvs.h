@@ -0,0 +1,46 @@
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Potentially visible set, built at level load.
+//
+
+
+#ifndef __R_PVS__
+#define __R_PVS__
+
+#include "r_defs.h"
+
+
+// Sector-to-sector visibility bit matrix, laid out like REJECT.
+// NULL if no PVS was built for the current level.
+extern byte *pvsmatrix;
+
+// Per-node and per-subsector flags for the current view sector,
+// nonzero if anything below may be visible.
+extern byte *pvsnodes;
+extern byte *pvssubsectors;
+
+// Fills matrix, laid out like REJECT, with a set bit for every
+// sector potentially visible from another, using the given slack
+// in map units.  Returns the number of sectors that ran out of
+// work and were marked as seeing everything, or -1 if the level
+// cannot be flowed at all.
+int R_SectorVisibility(byte *matrix, double epsilon);
+
+// Called from P_SetupLevel once the sector line lists exist.
+void R_BuildPVS(void);
+
+// Called once per frame; refreshes the node flags when the
+// view moves into a different sector.
+void R_SetupPVS(sector_t *viewsector);
+
+#endif
@@ -24,11 +24,16 @@
 
 #include "doomdef.h"
 
+#include "i_jobs.h"
 #include "i_swap.h"
 #include "i_system.h"
+#include "i_timer.h"
+#include "m_argv.h"
+#include "m_misc.h"
 #include "z_zone.h"
 #include "w_wad.h"
 
+#include "r_cache.h"
 #include "r_local.h"
 
 #include "doomstat.h"
@@ -83,9 +88,16 @@ short		screenheightarray[SCREENWIDTH];
 spritedef_t*	sprites;
 int		numsprites;
 
-spriteframe_t	sprtemp[29];
-int		maxframe;
-const char	*spritename;
+// Frames found for one sprite name.  Each name is scanned as
+//  a separate job, so errors are kept here and raised by
+//  R_InitSpriteDefs in name order rather than from the job.
+typedef struct
+{
+    const char*		spritename;
+    spriteframe_t	sprtemp[29];
+    int			maxframe;
+    char		error[80];
+} spritedefjob_t;
 
 
 
@@ -94,32 +106,46 @@ const char	*spritename;
 // R_InstallSpriteLump
 // Local function for R_InitSprites.
 //
-void
+static boolean
 R_InstallSpriteLump
-( int		lump,
+( spritedefjob_t*	job,
+  int		lump,
   unsigned	frame,
   unsigned	rotation,
   boolean	flipped )
 {
+    spriteframe_t*	sprtemp = job->sprtemp;
     int		r;
 	
     if (frame >= 29 || rotation > 8)
-	I_Error("R_InstallSpriteLump: "
-		"Bad frame characters in lump %i", lump);
+    {
+	M_snprintf(job->error, sizeof(job->error),
+		   "R_InstallSpriteLump: "
+		   "Bad frame characters in lump %i", lump);
+	return false;
+    }
 	
-    if ((int)frame > maxframe)
-	maxframe = frame;
+    if ((int)frame > job->maxframe)
+	job->maxframe = frame;
 		
     if (rotation == 0)
     {
 	// the lump should be used for all rotations
 	if (sprtemp[frame].rotate == false)
-	    I_Error ("R_InitSprites: Sprite %s frame %c has "
-		     "multip rot=0 lump", spritename, 'A'+frame);
+	{
+	    M_snprintf(job->error, sizeof(job->error),
+		       "R_InitSprites: Sprite %s frame %c has "
+		       "multip rot=0 lump", job->spritename, 'A'+frame);
+	    return false;
+	}
 
 	if (sprtemp[frame].rotate == true)
-	    I_Error ("R_InitSprites: Sprite %s frame %c has rotations "
-		     "and a rot=0 lump", spritename, 'A'+frame);
+	{
+	    M_snprintf(job->error, sizeof(job->error),
+		       "R_InitSprites: Sprite %s frame %c has rotations "
+		       "and a rot=0 lump", job->spritename, 'A'+frame);
+	    return false;
+	}
 			
 	sprtemp[frame].rotate = false;
 	for (r=0 ; r<8 ; r++)
@@ -127,25 +153,204 @@ R_InstallSpriteLump
 	    sprtemp[frame].lump[r] = lump - firstspritelump;
 	    sprtemp[frame].flip[r] = (byte)flipped;
 	}
-	return;
+	return true;
     }
 	
     // the lump is only used for one rotation
     if (sprtemp[frame].rotate == false)
-	I_Error ("R_InitSprites: Sprite %s frame %c has rotations "
-		 "and a rot=0 lump", spritename, 'A'+frame);
+    {
+	M_snprintf(job->error, sizeof(job->error),
+		   "R_InitSprites: Sprite %s frame %c has rotations "
+		   "and a rot=0 lump", job->spritename, 'A'+frame);
+	return false;
+    }
 		
     sprtemp[frame].rotate = true;
 
     // make 0 based
     rotation--;		
     if (sprtemp[frame].lump[rotation] != -1)
-	I_Error ("R_InitSprites: Sprite %s : %c : %c "
-		 "has two lumps mapped to it",
-		 spritename, 'A'+frame, '1'+rotation);
+    {
+	M_snprintf(job->error, sizeof(job->error),
+		   "R_InitSprites: Sprite %s : %c : %c "
+		   "has two lumps mapped to it",
+		   job->spritename, 'A'+frame, '1'+rotation);
+	return false;
+    }
 		
     sprtemp[frame].lump[rotation] = lump - firstspritelump;
     sprtemp[frame].flip[rotation] = (byte)flipped;
+    return true;
+}
+
+
+
+//
+// SpriteDefJob
+// Scans all the lump names for one sprite name,
+//  noting the highest frame letter.
+//
+static void SpriteDefJob (void *data, int i)
+{
+    spritedefjob_t*	job = (spritedefjob_t *) data + i;
+    spriteframe_t*	sprtemp = job->sprtemp;
+    int		l;
+    int		frame;
+    int		rotation;
+    int		patched;
+
+    memset (sprtemp,-1, sizeof(job->sprtemp));
+    job->maxframe = -1;
+    job->error[0] = '\0';
+	
+    // scan the lumps,
+    //  filling in the frames for whatever is found
+    for (l=firstspritelump ; l<=lastspritelump ; l++)
+    {
+	if (!strncasecmp(lumpinfo[l]->name, job->spritename, 4))
+	{
+	    frame = lumpinfo[l]->name[4] - 'A';
+	    rotation = lumpinfo[l]->name[5] - '0';
+
+	    if (modifiedgame)
+		patched = W_GetNumForName (lumpinfo[l]->name);
+	    else
+		patched = l;
+
+	    if (!R_InstallSpriteLump (job, patched, frame, rotation, false))
+		return;
+
+	    if (lumpinfo[l]->name[6])
+	    {
+		frame = lumpinfo[l]->name[6] - 'A';
+		rotation = lumpinfo[l]->name[7] - '0';
+		if (!R_InstallSpriteLump (job, l, frame, rotation, true))
+		    return;
+	    }
+	}
+    }
+	
+    // check the frames that were found for completeness
+    if (job->maxframe == -1)
+	return;
+		
+    for (frame = 0 ; frame <= job->maxframe ; frame++)
+    {
+	switch ((int)sprtemp[frame].rotate)
+	{
+	  case -1:
+	    // no rotations were found for that frame at all
+	    M_snprintf(job->error, sizeof(job->error),
+		       "R_InitSprites: No patches found "
+		       "for %s frame %c", job->spritename, frame+'A');
+	    return;
+		
+	  case 0:
+	    // only the first rotation is needed
+	    break;
+			
+	  case 1:
+	    // must have all 8 frames
+	    for (rotation=0 ; rotation<8 ; rotation++)
+	    {
+		if (sprtemp[frame].lump[rotation] == -1)
+		{
+		    M_snprintf(job->error, sizeof(job->error),
+			       "R_InitSprites: Sprite %s frame %c "
+			       "is missing rotations",
+			       job->spritename, frame+'A');
+		    return;
+		}
+	    }
+	    break;
+	}
+    }
+}
+
+
+
+
+//
+// CachedSpriteDefs
+// Fills in the sprite definitions from the render cache.
+// The section holds the frame count of each sprite followed
+//  by all of their frames.
+//
+static boolean CachedSpriteDefs (void)
+{
+    byte*	data;
+    int		length;
+    int		frames;
+    int		i;
+
+    data = R_CacheSection(RC_SPRITES, &length);
+
+    if (data == NULL || length < numsprites * (int) sizeof(int))
+	return false;
+
+    frames = 0;
+    for (i=0 ; i<numsprites ; i++)
+    {
+	memcpy(&sprites[i].numframes, data + i * sizeof(int), sizeof(int));
+	frames += sprites[i].numframes;
+    }
+
+    if (length != numsprites * sizeof(int) + frames * sizeof(spriteframe_t))
+	return false;
+
+    data += numsprites * sizeof(int);
+
+    for (i=0 ; i<numsprites ; i++)
+    {
+	if (sprites[i].numframes == 0)
+	    continue;
+
+	sprites[i].spriteframes =
+	    Z_Malloc (sprites[i].numframes * sizeof(spriteframe_t),
+		      PU_STATIC, NULL);
+	memcpy (sprites[i].spriteframes, data,
+		sprites[i].numframes * sizeof(spriteframe_t));
+	data += sprites[i].numframes * sizeof(spriteframe_t);
+    }
+
+    return true;
+}
+
+
+//
+// StoreSpriteDefs
+//
+static void StoreSpriteDefs (void)
+{
+    byte*	data;
+    byte*	p;
+    int		length;
+    int		i;
+
+    length = numsprites * sizeof(int);
+    for (i=0 ; i<numsprites ; i++)
+	length += sprites[i].numframes * sizeof(spriteframe_t);
+
+    data = p = Z_Malloc(length, PU_STATIC, NULL);
+
+    for (i=0 ; i<numsprites ; i++)
+    {
+	memcpy(p, &sprites[i].numframes, sizeof(int));
+	p += sizeof(int);
+    }
+
+    for (i=0 ; i<numsprites ; i++)
+    {
+	if (sprites[i].numframes == 0)
+	    continue;
+
+	memcpy(p, sprites[i].spriteframes,
+	       sprites[i].numframes * sizeof(spriteframe_t));
+	p += sprites[i].numframes * sizeof(spriteframe_t);
+    }
+
+    R_StoreCacheSection(RC_SPRITES, data, length);
+    Z_Free(data);
 }
 
 
@@ -169,13 +374,10 @@ R_InstallSpriteLump
 void R_InitSpriteDefs(const char **namelist)
 { 
     const char **check;
+    spritedefjob_t*	jobs;
     int		i;
-    int		l;
-    int		frame;
-    int		rotation;
-    int		start;
-    int		end;
-    int		patched;
+    int		maxframe;
+    int		starttime;
 		
     // count the number of sprite names
     check = namelist;
@@ -186,88 +388,53 @@ void R_InitSpriteDefs(const char **namelist)
 	
     if (!numsprites)
 	return;
+
+    starttime = I_GetTimeMS();
 		
     sprites = Z_Malloc(numsprites *sizeof(*sprites), PU_STATIC, NULL);
-	
-    start = firstspritelump-1;
-    end = lastspritelump+1;
-	
-    // scan all the lump names for each of the names,
-    //  noting the highest frame letter.
-    // Just compare 4 characters as ints
+
+    if (CachedSpriteDefs ())
+	return;
+
+    jobs = Z_Malloc(numsprites * sizeof(*jobs), PU_STATIC, NULL);
+
     for (i=0 ; i<numsprites ; i++)
-    {
-	spritename = namelist[i];
-	memset (sprtemp,-1, sizeof(sprtemp));
-		
-	maxframe = -1;
-	
-	// scan the lumps,
-	//  filling in the frames for whatever is found
-	for (l=start+1 ; l<end ; l++)
-	{
-	    if (!strncasecmp(lumpinfo[l]->name, spritename, 4))
-	    {
-		frame = lumpinfo[l]->name[4] - 'A';
-		rotation = lumpinfo[l]->name[5] - '0';
+	jobs[i].spritename = namelist[i];
 
-		if (modifiedgame)
-		    patched = W_GetNumForName (lumpinfo[l]->name);
-		else
-		    patched = l;
+    I_RunJobs (SpriteDefJob, jobs, numsprites);
 
-		R_InstallSpriteLump (patched, frame, rotation, false);
+    // Merge in name order, so the first error is the one
+    //  a serial scan would have stopped at.
+    for (i=0 ; i<numsprites ; i++)
+    {
+	if (jobs[i].error[0] != '\0')
+	    I_Error ("%s", jobs[i].error);
 
-		if (lumpinfo[l]->name[6])
-		{
-		    frame = lumpinfo[l]->name[6] - 'A';
-		    rotation = lumpinfo[l]->name[7] - '0';
-		    R_InstallSpriteLump (l, frame, rotation, true);
-		}
-	    }
-	}
-	
-	// check the frames that were found for completeness
-	if (maxframe == -1)
+	if (jobs[i].maxframe == -1)
 	{
 	    sprites[i].numframes = 0;
 	    continue;
 	}
 		
-	maxframe++;
-	
-	for (frame = 0 ; frame < maxframe ; frame++)
-	{
-	    switch ((int)sprtemp[frame].rotate)
-	    {
-	      case -1:
-		// no rotations were found for that frame at all
-		I_Error ("R_InitSprites: No patches found "
-			 "for %s frame %c", spritename, frame+'A');
-		break;
-		
-	      case 0:
-		// only the first rotation is needed
-		break;
-			
-	      case 1:
-		// must have all 8 frames
-		for (rotation=0 ; rotation<8 ; rotation++)
-		    if (sprtemp[frame].lump[rotation] == -1)
-			I_Error ("R_InitSprites: Sprite %s frame %c "
-				 "is missing rotations",
-				 spritename, frame+'A');
-		break;
-	    }
-	}
+	maxframe = jobs[i].maxframe + 1;
 	
 	// allocate space for the frames present and copy sprtemp to it
 	sprites[i].numframes = maxframe;
 	sprites[i].spriteframes = 
 	    Z_Malloc (maxframe * sizeof(spriteframe_t), PU_STATIC, NULL);
-	memcpy (sprites[i].spriteframes, sprtemp, maxframe*sizeof(spriteframe_t));
+	memcpy (sprites[i].spriteframes, jobs[i].sprtemp,
+		maxframe*sizeof(spriteframe_t));
     }
 
+    Z_Free(jobs);
+
+    StoreSpriteDefs ();
+
+    if (M_CheckParm("-timestartup"))
+    {
+	printf ("R_InitSpriteDefs: %i sprites, %i ms (%i threads)\n",
+		numsprites, I_GetTimeMS() - starttime, I_NumJobThreads());
+    }
 }
 
 
@@ -296,6 +463,9 @@ void R_InitSprites(const char **namelist)
     }
 	
     R_InitSpriteDefs (namelist);
+
+    // Sprites are the last of the cached render data.
+    R_CloseRenderCache ();
 }
 
 
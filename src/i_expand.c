@@ -0,0 +1,281 @@
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//      Expansion of the 8-bit screen buffer to 32-bit pixels.
+//
+//      Each source row is expanded once by a row kernel, which also
+//      repeats pixels horizontally, and then copied for the vertical
+//      scale.  The SIMD kernels handle horizontal scales of 1, 2 and 4
+//      and fall back to the plain C kernel for anything else.
+//
+
+#include <string.h>
+
+#include "SDL.h"
+
+#include "i_expand.h"
+#include "i_video.h"
+#include "m_argv.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAVE_EXPAND_X86
+#include <immintrin.h>
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define HAVE_EXPAND_NEON
+#include <arm_neon.h>
+#endif
+
+typedef void (*expand_row_t)(const pixel_t *src, uint32_t *dest,
+                             const uint32_t *palette, int xscale);
+
+static void ExpandRowC(const pixel_t *src, uint32_t *dest,
+                       const uint32_t *palette, int xscale)
+{
+    uint32_t c;
+    int x, i;
+
+    if (xscale == 1)
+    {
+        for (x = 0; x < SCREENWIDTH; x += 4)
+        {
+            dest[x] = palette[src[x]];
+            dest[x + 1] = palette[src[x + 1]];
+            dest[x + 2] = palette[src[x + 2]];
+            dest[x + 3] = palette[src[x + 3]];
+        }
+        return;
+    }
+
+    for (x = 0; x < SCREENWIDTH; ++x)
+    {
+        c = palette[src[x]];
+
+        for (i = 0; i < xscale; ++i)
+        {
+            *dest++ = c;
+        }
+    }
+}
+
+#ifdef HAVE_EXPAND_X86
+
+// SSE2 has no gather, so the lookups stay scalar; the gain is in
+// writing the repeated pixels four at a time.
+
+__attribute__((target("sse2")))
+static void ExpandRowSSE2(const pixel_t *src, uint32_t *dest,
+                          const uint32_t *palette, int xscale)
+{
+    __m128i v;
+    int x;
+
+    if (xscale != 1 && xscale != 2 && xscale != 4)
+    {
+        ExpandRowC(src, dest, palette, xscale);
+        return;
+    }
+
+    for (x = 0; x < SCREENWIDTH; x += 4)
+    {
+        v = _mm_set_epi32(palette[src[x + 3]], palette[src[x + 2]],
+                          palette[src[x + 1]], palette[src[x]]);
+
+        if (xscale == 1)
+        {
+            _mm_storeu_si128((__m128i *) dest, v);
+            dest += 4;
+        }
+        else if (xscale == 2)
+        {
+            _mm_storeu_si128((__m128i *) dest, _mm_unpacklo_epi32(v, v));
+            _mm_storeu_si128((__m128i *) (dest + 4),
+                             _mm_unpackhi_epi32(v, v));
+            dest += 8;
+        }
+        else
+        {
+            _mm_storeu_si128((__m128i *) dest, _mm_shuffle_epi32(v, 0x00));
+            _mm_storeu_si128((__m128i *) (dest + 4),
+                             _mm_shuffle_epi32(v, 0x55));
+            _mm_storeu_si128((__m128i *) (dest + 8),
+                             _mm_shuffle_epi32(v, 0xaa));
+            _mm_storeu_si128((__m128i *) (dest + 12),
+                             _mm_shuffle_epi32(v, 0xff));
+            dest += 16;
+        }
+    }
+}
+
+// AVX2 gathers eight palette entries at once.
+
+__attribute__((target("avx2")))
+static void ExpandRowAVX2(const pixel_t *src, uint32_t *dest,
+                          const uint32_t *palette, int xscale)
+{
+    __m256i idx, v, lo, hi;
+    int x;
+
+    if (xscale != 1 && xscale != 2)
+    {
+        ExpandRowSSE2(src, dest, palette, xscale);
+        return;
+    }
+
+    for (x = 0; x < SCREENWIDTH; x += 8)
+    {
+        idx = _mm256_cvtepu8_epi32(
+                  _mm_loadl_epi64((const __m128i *) (src + x)));
+        v = _mm256_i32gather_epi32((const int *) palette, idx, 4);
+
+        if (xscale == 1)
+        {
+            _mm256_storeu_si256((__m256i *) dest, v);
+            dest += 8;
+        }
+        else
+        {
+            // unpack works within each 128-bit half, so the halves
+            // need putting back in order afterwards.
+
+            lo = _mm256_unpacklo_epi32(v, v);
+            hi = _mm256_unpackhi_epi32(v, v);
+            _mm256_storeu_si256((__m256i *) dest,
+                                _mm256_permute2x128_si256(lo, hi, 0x20));
+            _mm256_storeu_si256((__m256i *) (dest + 8),
+                                _mm256_permute2x128_si256(lo, hi, 0x31));
+            dest += 16;
+        }
+    }
+}
+
+#endif
+
+#ifdef HAVE_EXPAND_NEON
+
+static void ExpandRowNEON(const pixel_t *src, uint32_t *dest,
+                          const uint32_t *palette, int xscale)
+{
+    uint32_t lanes[4];
+    uint32x4_t v;
+    uint32x4x2_t z;
+    int x, i;
+
+    if (xscale != 1 && xscale != 2 && xscale != 4)
+    {
+        ExpandRowC(src, dest, palette, xscale);
+        return;
+    }
+
+    for (x = 0; x < SCREENWIDTH; x += 4)
+    {
+        lanes[0] = palette[src[x]];
+        lanes[1] = palette[src[x + 1]];
+        lanes[2] = palette[src[x + 2]];
+        lanes[3] = palette[src[x + 3]];
+        v = vld1q_u32(lanes);
+
+        if (xscale == 1)
+        {
+            vst1q_u32(dest, v);
+            dest += 4;
+        }
+        else if (xscale == 2)
+        {
+            z = vzipq_u32(v, v);
+            vst1q_u32(dest, z.val[0]);
+            vst1q_u32(dest + 4, z.val[1]);
+            dest += 8;
+        }
+        else
+        {
+            for (i = 0; i < 4; ++i)
+            {
+                vst1q_u32(dest, vdupq_n_u32(lanes[i]));
+                dest += 4;
+            }
+        }
+    }
+}
+
+#endif
+
+static expand_row_t expand_row = ExpandRowC;
+static const char *expand_name = "C";
+
+void I_InitExpand(void)
+{
+    expand_row = ExpandRowC;
+    expand_name = "C";
+
+    //!
+    // @category video
+    //
+    // Expand the screen to 32-bit pixels with plain C code, rather
+    // than the fastest SIMD kernel the CPU supports.
+    //
+
+    if (M_ParmExists("-nosimd"))
+    {
+        return;
+    }
+
+#ifdef HAVE_EXPAND_X86
+    if (SDL_HasAVX2())
+    {
+        expand_row = ExpandRowAVX2;
+        expand_name = "AVX2";
+    }
+    else if (SDL_HasSSE2())
+    {
+        expand_row = ExpandRowSSE2;
+        expand_name = "SSE2";
+    }
+#endif
+
+#ifdef HAVE_EXPAND_NEON
+    if (SDL_HasNEON())
+    {
+        expand_row = ExpandRowNEON;
+        expand_name = "NEON";
+    }
+#endif
+}
+
+const char *I_ExpandKernelName(void)
+{
+    return expand_name;
+}
+
+void I_ExpandPixels(const pixel_t *src, void *dest, int pitch,
+                    const uint32_t *palette, int xscale, int yscale)
+{
+    byte *row;
+    int y, i;
+
+    row = dest;
+
+    for (y = 0; y < SCREENHEIGHT; ++y)
+    {
+        expand_row(src, (uint32_t *) row, palette, xscale);
+
+        for (i = 1; i < yscale; ++i)
+        {
+            memcpy(row + i * pitch, row, SCREENWIDTH * xscale * 4);
+        }
+
+        src += SCREENWIDTH;
+        row += yscale * pitch;
+    }
+}
+
@@ -0,0 +1,38 @@
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//      Expansion of the 8-bit screen buffer to 32-bit pixels.
+//
+
+
+#ifndef __I_EXPAND__
+#define __I_EXPAND__
+
+#include "doomtype.h"
+
+// Pick the fastest kernel the CPU supports.
+
+void I_InitExpand(void);
+
+// Name of the kernel in use, for startup messages.
+
+const char *I_ExpandKernelName(void);
+
+// Expand a SCREENWIDTH x SCREENHEIGHT 8-bit buffer through a table of
+// 32-bit colors into dest, which is pitch bytes per row.  Each source
+// pixel becomes an xscale x yscale block ("nearest" upscaling).
+
+void I_ExpandPixels(const pixel_t *src, void *dest, int pitch,
+                    const uint32_t *palette, int xscale, int yscale);
+
+#endif
+
@@ -0,0 +1,168 @@
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Null video, input, joystick and sound backends for the
+//	simulation-only build.  Nothing is displayed or read from
+//	the user; tics run as fast as the playsim allows.
+//
+
+#include <string.h>
+
+#include "doomtype.h"
+#include "i_endoom.h"
+#include "i_input.h"
+#include "i_joystick.h"
+#include "i_sound.h"
+#include "i_system.h"
+#include "i_video.h"
+#include "net_gui.h"
+#include "v_video.h"
+#include "z_zone.h"
+
+// D_RunFrame checks this before drawing; with it false the
+// renderer never runs.
+
+boolean screenvisible = false;
+boolean screensaver_mode = false;
+
+pixel_t *I_VideoBuffer = NULL;
+
+char *video_driver = "";
+int usemouse = 0;
+int usegamma = 0;
+int fullscreen = false;
+int aspect_ratio_correct = false;
+int png_screenshots = false;
+unsigned int joywait = 0;
+
+int vanilla_keyboard_mapping = true;
+float mouse_acceleration = 2.0;
+int mouse_threshold = 10;
+
+int use_libsamplerate = 0;
+float libsamplerate_scale = 0.65f;
+
+void I_InitGraphics(void)
+{
+    // Nothing is shown, but screen wipes and the automap still expect
+    // a canvas to exist.
+
+    I_VideoBuffer = Z_Malloc(SCREENWIDTH * SCREENHEIGHT * sizeof(*I_VideoBuffer),
+                             PU_STATIC, NULL);
+    memset(I_VideoBuffer, 0, SCREENWIDTH * SCREENHEIGHT * sizeof(*I_VideoBuffer));
+
+    V_RestoreBuffer();
+}
+
+void I_GraphicsCheckCommandLine(void)
+{
+}
+
+void I_SetPalette(byte *palette)
+{
+}
+
+int I_GetPaletteIndex(int r, int g, int b)
+{
+    return 0;
+}
+
+void I_UpdateNoBlit(void)
+{
+}
+
+void I_FinishUpdate(void)
+{
+}
+
+void I_ReadScreen(pixel_t *scr)
+{
+    memcpy(scr, I_VideoBuffer, SCREENWIDTH * SCREENHEIGHT * sizeof(*scr));
+}
+
+void I_SetWindowTitle(const char *title)
+{
+}
+
+void I_CheckIsScreensaver(void)
+{
+}
+
+void I_SetGrabMouseCallback(grabmouse_callback_t func)
+{
+}
+
+void I_DisplayFPSDots(boolean dots_on)
+{
+}
+
+void I_BindVideoVariables(void)
+{
+}
+
+void I_RegisterWindowIcon(const unsigned int *icon, int width, int height)
+{
+}
+
+void I_StartFrame(void)
+{
+}
+
+void I_StartTic(void)
+{
+}
+
+void I_StartTextInput(int x1, int y1, int x2, int y2)
+{
+}
+
+void I_StopTextInput(void)
+{
+}
+
+void I_BindInputVariables(void)
+{
+}
+
+void I_InitJoystick(void)
+{
+}
+
+void I_BindJoystickVariables(void)
+{
+}
+
+void I_Endoom(byte *data)
+{
+}
+
+void I_SetOPLDriverVer(opl_driver_ver_t ver)
+{
+}
+
+void I_OPL_DevMessages(char *result, size_t result_len)
+{
+    if (result_len > 0)
+    {
+        result[0] = '\0';
+    }
+}
+
+// Every network game, including -server, waits here for the launch.
+// The simulator runs one tic per frame regardless of the other nodes,
+// so it cannot stay in sync with them.
+
+void NET_WaitForLaunch(void)
+{
+    I_Error("NET_WaitForLaunch: network games are not supported "
+            "in the headless build");
+}
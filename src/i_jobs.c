@@ -0,0 +1,237 @@
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//      Simple job system for running independent work on
+//      worker threads.
+//
+
+#include <stdlib.h>
+
+#include "SDL.h"
+
+#include "doomtype.h"
+#include "i_jobs.h"
+#include "i_system.h"
+#include "m_argv.h"
+
+#define MAX_JOB_THREADS 16
+
+static int num_job_threads = 0;
+
+static job_func_t batch_func;
+static void *batch_data;
+static int batch_count;
+static SDL_atomic_t batch_next;
+static boolean batch_running = false;
+
+// The workers are started with the first batch and then stay parked
+// on pool_wake between batches, so a batch costs a wakeup rather
+// than a thread creation.  pool_generation counts batches handed
+// out; pool_busy counts workers still draining the current one.
+
+static int num_workers;
+static boolean pool_started = false;
+
+static SDL_mutex *pool_lock;
+static SDL_cond *pool_wake;
+static SDL_cond *pool_done;
+static int pool_generation;
+static int pool_busy;
+
+int I_NumJobThreads(void)
+{
+    int p;
+
+    if (num_job_threads > 0)
+    {
+        return num_job_threads;
+    }
+
+    //!
+    // @arg <n>
+    // @category obscure
+    //
+    // Use n threads for startup and level loading work.  The default
+    // is one per CPU; 1 runs everything on the main thread.
+    //
+
+    p = M_CheckParmWithArgs("-jobs", 1);
+
+    if (p > 0)
+    {
+        num_job_threads = atoi(myargv[p + 1]);
+    }
+    else
+    {
+        num_job_threads = SDL_GetCPUCount();
+    }
+
+    if (num_job_threads < 1)
+    {
+        num_job_threads = 1;
+    }
+    else if (num_job_threads > MAX_JOB_THREADS)
+    {
+        num_job_threads = MAX_JOB_THREADS;
+    }
+
+    return num_job_threads;
+}
+
+// Take indices off the current batch until none are left.
+
+static void DrainBatch(void)
+{
+    int i;
+
+    for (;;)
+    {
+        i = SDL_AtomicAdd(&batch_next, 1);
+
+        if (i >= batch_count)
+        {
+            break;
+        }
+
+        batch_func(batch_data, i);
+    }
+}
+
+static int WorkerThread(void *unused)
+{
+    int seen = 0;
+
+    SDL_LockMutex(pool_lock);
+
+    for (;;)
+    {
+        while (pool_generation == seen)
+        {
+            SDL_CondWait(pool_wake, pool_lock);
+        }
+
+        seen = pool_generation;
+        SDL_UnlockMutex(pool_lock);
+
+        DrainBatch();
+
+        SDL_LockMutex(pool_lock);
+
+        --pool_busy;
+
+        if (pool_busy == 0)
+        {
+            SDL_CondSignal(pool_done);
+        }
+    }
+
+    return 0;
+}
+
+static void StartPool(void)
+{
+    SDL_Thread *worker;
+    int threads;
+    int i;
+
+    pool_started = true;
+
+    pool_lock = SDL_CreateMutex();
+    pool_wake = SDL_CreateCond();
+    pool_done = SDL_CreateCond();
+
+    if (pool_lock == NULL || pool_wake == NULL || pool_done == NULL)
+    {
+        return;
+    }
+
+    // The calling thread joins in from I_FinishJobs, so one
+    // fewer worker is needed.
+
+    threads = I_NumJobThreads() - 1;
+
+    for (i = 0; i < threads; ++i)
+    {
+        worker = SDL_CreateThread(WorkerThread, "Job thread", NULL);
+
+        // If a thread cannot be created the work still gets done,
+        // just by fewer threads.
+
+        if (worker != NULL)
+        {
+            SDL_DetachThread(worker);
+            ++num_workers;
+        }
+    }
+}
+
+void I_StartJobs(job_func_t func, void *data, int count)
+{
+    if (batch_running)
+    {
+        I_Error("I_StartJobs: a batch is already running");
+    }
+
+    if (!pool_started)
+    {
+        StartPool();
+    }
+
+    batch_func = func;
+    batch_data = data;
+    batch_count = count;
+    SDL_AtomicSet(&batch_next, 0);
+    batch_running = true;
+
+    if (num_workers > 0)
+    {
+        SDL_LockMutex(pool_lock);
+        pool_busy = num_workers;
+        ++pool_generation;
+        SDL_CondBroadcast(pool_wake);
+        SDL_UnlockMutex(pool_lock);
+    }
+}
+
+void I_FinishJobs(void)
+{
+    if (!batch_running)
+    {
+        return;
+    }
+
+    DrainBatch();
+
+    // Every index has been taken, but a worker may still be
+    // finishing the last one it took.
+
+    if (num_workers > 0)
+    {
+        SDL_LockMutex(pool_lock);
+
+        while (pool_busy > 0)
+        {
+            SDL_CondWait(pool_done, pool_lock);
+        }
+
+        SDL_UnlockMutex(pool_lock);
+    }
+
+    batch_running = false;
+}
+
+void I_RunJobs(job_func_t func, void *data, int count)
+{
+    I_StartJobs(func, data, count);
+    I_FinishJobs();
+}
+
@@ -0,0 +1,49 @@
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//      Simple job system for running independent work on
+//      worker threads.
+//
+
+
+#ifndef __I_JOBS__
+#define __I_JOBS__
+
+// A job function is called once for each index of a batch.  It may
+// run on any thread, so it must not touch the zone allocator, the
+// WAD cache or anything else shared that is not safe to read
+// concurrently.  Each index should write only to its own results,
+// which the caller then merges in order once the batch is finished.
+
+typedef void (*job_func_t)(void *data, int index);
+
+// Number of threads that batches are spread across, including
+// the calling thread.
+
+int I_NumJobThreads(void);
+
+// Start running func(data, i) for i in [0, count) in the background.
+// Only one batch may be in flight at a time.
+
+void I_StartJobs(job_func_t func, void *data, int count);
+
+// Wait for the current batch to finish, helping out on the calling
+// thread with any indices that have not yet been started.
+
+void I_FinishJobs(void);
+
+// Run a whole batch and wait for it.
+
+void I_RunJobs(job_func_t func, void *data, int count);
+
+#endif
+
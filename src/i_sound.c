@@ -18,8 +18,6 @@
 #include <stdio.h>
 #include <stdlib.h>
 
-#include "SDL_mixer.h"
-
 #include "config.h"
 #include "doomtype.h"
 
@@ -59,10 +57,13 @@ static const music_module_t *music_module;
 static const music_module_t *active_music_module;
 
 // Compiled-in sound modules:
+// The headless build has none, so sound and music are always off.
 
 static const sound_module_t *sound_modules[] =
 {
+#ifndef HEADLESS
     &sound_sdl_module,
+#endif
     NULL,
 };
 
@@ -70,7 +71,9 @@ static const sound_module_t *sound_modules[] =
 
 static const music_module_t *music_modules[] =
 {
+#ifndef HEADLESS
     &music_opl_module,
+#endif
     NULL,
 };
 
@@ -26,6 +26,7 @@
 #include "config.h"
 #include "d_loop.h"
 #include "doomtype.h"
+#include "i_expand.h"
 #include "i_input.h"
 #include "i_joystick.h"
 #include "i_system.h"
@@ -51,29 +52,43 @@ static SDL_Renderer *renderer;
 static const char *window_title = "";
 
 // These are (1) the 320x200x8 paletted buffer that we draw to (i.e. the one
-// that holds I_VideoBuffer), (2) the 320x200x32 RGBA intermediate buffer that
-// we blit the former buffer to, (3) the intermediate 320x200 texture that we
-// load the RGBA buffer to and that we render into another texture (4) which
-// is upscaled by an integer factor UPSCALE using "nearest" scaling and which
-// in turn is finally rendered to screen using "linear" scaling.
+// that holds I_VideoBuffer), (2) the intermediate 320x200 streaming texture
+// that the former buffer is expanded into through the palette and that we
+// render into another texture (3) which is upscaled by an integer factor
+// UPSCALE using "nearest" scaling and which in turn is finally rendered to
+// screen using "linear" scaling.  When the screen is an exact integer
+// multiple of the intermediate texture, (3) is skipped and the intermediate
+// texture is rendered straight to screen with "nearest" scaling.
 
 static SDL_Surface *screenbuffer = NULL;
-static SDL_Surface *argbbuffer = NULL;
 static SDL_Texture *texture = NULL;
 static SDL_Texture *texture_upscaled = NULL;
 
-static SDL_Rect blit_rect = {
-    0,
-    0,
-    SCREENWIDTH,
-    SCREENHEIGHT
-};
-
 static uint32_t pixel_format;
 
-// palette
+// Format of the intermediate texture; always 32 bits per pixel.
+
+static uint32_t texture_format;
+static SDL_PixelFormat *texture_format_info = NULL;
+
+// Render the intermediate texture straight to screen?
+
+static boolean present_direct;
+
+// With the software renderer every render pass runs on the CPU anyway,
+// so the screen is expanded and upscaled in a single pass straight into
+// a streaming texture_upscaled instead.
+
+static boolean expand_upscaled;
+
+// Current upscale factors of texture_upscaled.
+
+static int w_upscale_cur, h_upscale_cur;
+
+// palette, and the same colors as texture_format pixels
 
 static SDL_Color palette[256];
+static uint32_t palette_pixels[256];
 static boolean palette_to_set;
 
 // display has been set up?
@@ -603,7 +618,6 @@ static void CreateUpscaledTexture(boolean force)
 {
     int w, h;
     int h_upscale, w_upscale;
-    static int h_upscale_old, w_upscale_old;
 
     SDL_Texture *new_texture, *old_texture;
 
@@ -632,6 +646,17 @@ static void CreateUpscaledTexture(boolean force)
         w = h * SCREENWIDTH / actualheight;
     }
 
+    // If the rendered area is an exact multiple of the screen dimensions,
+    // "nearest" scaling straight to screen gives the same picture as the
+    // upscaled texture would, with one render pass fewer.  With integer
+    // scaling SDL itself rounds the area down to such a multiple.  This
+    // needs the logical size set in SetVideoMode; without it the texture
+    // is stretched over the whole output rather than the area above.
+
+    present_direct = (aspect_ratio_correct || integer_scaling)
+                  && ((w % SCREENWIDTH == 0 && h % SCREENHEIGHT == 0)
+                   || (integer_scaling && actualheight == SCREENHEIGHT));
+
     // Pick texture size the next integer multiple of the screen dimensions.
     // If one screen dimension matches an integer multiple of the original
     // resolution, there is no need to overscale in this direction.
@@ -654,13 +679,13 @@ static void CreateUpscaledTexture(boolean force)
 
     // Create a new texture only if the upscale factors have actually changed.
 
-    if (h_upscale == h_upscale_old && w_upscale == w_upscale_old && !force)
+    if (h_upscale == h_upscale_cur && w_upscale == w_upscale_cur && !force)
     {
         return;
     }
 
-    h_upscale_old = h_upscale;
-    w_upscale_old = w_upscale;
+    h_upscale_cur = h_upscale;
+    w_upscale_cur = w_upscale;
 
     // Set the scaling quality for rendering the upscaled texture to "linear",
     // which looks much softer and smoother than "nearest" but does a better
@@ -668,11 +693,22 @@ static void CreateUpscaledTexture(boolean force)
 
     SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "linear");
 
-    new_texture = SDL_CreateTexture(renderer,
-                                pixel_format,
-                                SDL_TEXTUREACCESS_TARGET,
-                                w_upscale*SCREENWIDTH,
-                                h_upscale*SCREENHEIGHT);
+    if (expand_upscaled)
+    {
+        new_texture = SDL_CreateTexture(renderer,
+                                    texture_format,
+                                    SDL_TEXTUREACCESS_STREAMING,
+                                    w_upscale*SCREENWIDTH,
+                                    h_upscale*SCREENHEIGHT);
+    }
+    else
+    {
+        new_texture = SDL_CreateTexture(renderer,
+                                    pixel_format,
+                                    SDL_TEXTUREACCESS_TARGET,
+                                    w_upscale*SCREENWIDTH,
+                                    h_upscale*SCREENHEIGHT);
+    }
 
     old_texture = texture_upscaled;
     texture_upscaled = new_texture;
@@ -691,6 +727,8 @@ void I_FinishUpdate (void)
     static int lasttic;
     int tics;
     int i;
+    void *pixels;
+    int pitch;
 
     if (!initialized)
         return;
@@ -756,7 +794,11 @@ void I_FinishUpdate (void)
 
     if (palette_to_set)
     {
-        SDL_SetPaletteColors(screenbuffer->format->palette, palette, 0, 256);
+        for (i = 0; i < 256; ++i)
+        {
+            palette_pixels[i] = SDL_MapRGB(texture_format_info, palette[i].r,
+                                           palette[i].g, palette[i].b);
+        }
         palette_to_set = false;
 
         if (vga_porch_flash)
@@ -768,29 +810,62 @@ void I_FinishUpdate (void)
         }
     }
 
-    // Blit from the paletted 8-bit screen buffer to the intermediate
-    // 32-bit RGBA buffer that we can load into the texture.
-
-    SDL_LowerBlit(screenbuffer, &blit_rect, argbbuffer, &blit_rect);
+    if (expand_upscaled)
+    {
+        // Expand and upscale the paletted 8-bit screen buffer in one go,
+        // straight into the upscaled texture.
 
-    // Update the intermediate texture with the contents of the RGBA buffer.
+        if (SDL_LockTexture(texture_upscaled, NULL, &pixels, &pitch) == 0)
+        {
+            I_ExpandPixels(I_VideoBuffer, pixels, pitch, palette_pixels,
+                           w_upscale_cur, h_upscale_cur);
+            SDL_UnlockTexture(texture_upscaled);
+        }
+    }
+    else
+    {
+        // Expand the paletted 8-bit screen buffer straight into the
+        // intermediate texture.
 
-    SDL_UpdateTexture(texture, NULL, argbbuffer->pixels, argbbuffer->pitch);
+        if (SDL_LockTexture(texture, NULL, &pixels, &pitch) == 0)
+        {
+            I_ExpandPixels(I_VideoBuffer, pixels, pitch, palette_pixels,
+                           1, 1);
+            SDL_UnlockTexture(texture);
+        }
+    }
 
     // Make sure the pillarboxes are kept clear each frame.
 
     SDL_RenderClear(renderer);
 
-    // Render this intermediate texture into the upscaled texture
-    // using "nearest" integer scaling.
+    if (expand_upscaled)
+    {
+        // Render the upscaled texture to screen using linear scaling.
+
+        SDL_RenderCopy(renderer, texture_upscaled, NULL, NULL);
+    }
+    else if (present_direct)
+    {
+        // Render the intermediate texture straight to screen using
+        // "nearest" integer scaling.
+
+        SDL_RenderCopy(renderer, texture, NULL, NULL);
+    }
+    else
+    {
+        // Render this intermediate texture into the upscaled texture
+        // using "nearest" integer scaling.
 
-    SDL_SetRenderTarget(renderer, texture_upscaled);
-    SDL_RenderCopy(renderer, texture, NULL, NULL);
+        SDL_SetRenderTarget(renderer, texture_upscaled);
+        SDL_RenderCopy(renderer, texture, NULL, NULL);
 
-    // Finally, render this upscaled texture to screen using linear scaling.
+        // Finally, render this upscaled texture to screen using linear
+        // scaling.
 
-    SDL_SetRenderTarget(renderer, NULL);
-    SDL_RenderCopy(renderer, texture_upscaled, NULL, NULL);
+        SDL_SetRenderTarget(renderer, NULL);
+        SDL_RenderCopy(renderer, texture_upscaled, NULL, NULL);
+    }
 
     // Draw!
 
@@ -1169,8 +1244,6 @@ static void SetVideoMode(void)
 {
     int w, h;
     int x, y;
-    unsigned int rmask, gmask, bmask, amask;
-    int bpp;
     int window_flags = 0, renderer_flags = 0;
     SDL_DisplayMode mode;
 
@@ -1291,6 +1364,8 @@ static void SetVideoMode(void)
                 SDL_GetError());
     }
 
+    expand_upscaled = force_software_renderer;
+
     // Important: Set the "logical size" of the rendering context. At the same
     // time this also defines the aspect ratio that is preserved while scaling
     // and stretching the texture into the window.
@@ -1329,25 +1404,34 @@ static void SetVideoMode(void)
         SDL_FillRect(screenbuffer, NULL, 0);
     }
 
-    // Format of argbbuffer must match the screen pixel format because we
-    // import the surface data into the texture.
+    // The intermediate texture matches the screen pixel format where we
+    // can write that directly, so the renderer has nothing to convert.
+
+    if (SDL_BYTESPERPIXEL(pixel_format) == 4)
+    {
+        texture_format = pixel_format;
+    }
+    else
+    {
+        texture_format = SDL_PIXELFORMAT_ARGB8888;
+    }
 
-    if (argbbuffer != NULL)
+    if (texture_format_info != NULL)
     {
-        SDL_FreeSurface(argbbuffer);
-        argbbuffer = NULL;
+        SDL_FreeFormat(texture_format_info);
     }
 
-    if (argbbuffer == NULL)
+    texture_format_info = SDL_AllocFormat(texture_format);
+
+    if (texture_format_info == NULL)
     {
-        SDL_PixelFormatEnumToMasks(pixel_format, &bpp,
-                                   &rmask, &gmask, &bmask, &amask);
-        argbbuffer = SDL_CreateRGBSurface(0,
-                                          SCREENWIDTH, SCREENHEIGHT, bpp,
-                                          rmask, gmask, bmask, amask);
-        SDL_FillRect(argbbuffer, NULL, 0);
+        I_Error("Failed to allocate pixel format: %s", SDL_GetError());
     }
 
+    // Colors have to be mapped again for the new format.
+
+    palette_to_set = true;
+
     if (texture != NULL)
     {
         SDL_DestroyTexture(texture);
@@ -1359,12 +1443,12 @@ static void SetVideoMode(void)
 
     SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "nearest");
 
-    // Create the intermediate texture that the RGBA surface gets loaded into.
-    // The SDL_TEXTUREACCESS_STREAMING flag means that this texture's content
-    // is going to change frequently.
+    // Create the intermediate texture that the screen buffer gets expanded
+    // into. The SDL_TEXTUREACCESS_STREAMING flag means that this texture's
+    // content is going to change frequently, and lets us lock it.
 
     texture = SDL_CreateTexture(renderer,
-                                pixel_format,
+                                texture_format,
                                 SDL_TEXTUREACCESS_STREAMING,
                                 SCREENWIDTH, SCREENHEIGHT);
 
@@ -1398,6 +1482,9 @@ void I_InitGraphics(void)
 
     SetSDLVideoDriver();
 
+    I_InitExpand();
+    printf("I_InitGraphics: %s palette expansion\n", I_ExpandKernelName());
+
     if (SDL_Init(SDL_INIT_VIDEO) < 0) 
     {
         I_Error("Failed to initialize video: %s", SDL_GetError());
@@ -1433,7 +1520,6 @@ void I_InitGraphics(void)
 
     doompal = W_CacheLumpName("PLAYPAL", PU_CACHE);
     I_SetPalette(doompal);
-    SDL_SetPaletteColors(screenbuffer->format->palette, palette, 0, 256);
 
     // SDL2-TODO UpdateFocus();
     UpdateGrab();
@@ -1449,9 +1535,9 @@ void I_InitGraphics(void)
     }
 
     // The actual 320x200 canvas that we draw to. This is the pixel buffer of
-    // the 8-bit paletted screen buffer that gets blit on an intermediate
-    // 32-bit RGBA screen buffer that gets loaded into a texture that gets
-    // finally rendered into our window or full screen in I_FinishUpdate().
+    // the 8-bit paletted screen buffer that gets expanded into a texture
+    // that gets finally rendered into our window or full screen in
+    // I_FinishUpdate().
 
     I_VideoBuffer = screenbuffer->pixels;
     V_RestoreBuffer();